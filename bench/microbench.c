@@ -0,0 +1,206 @@
+/***
+	microbench.c: interpreter core microbenchmarks for the Unix build
+
+	Times the pieces the interpreter spends its time in: lexing, expression
+	evaluation, calls to built-in, EEPROM and file functions, while and
+	switch, printf formatting and task dispatch.  Each is calibrated to
+	about 10 ms a sample and sampled SAMPLES times; the table gives the mean
+	ns per operation, its standard deviation as a percentage, and the best
+	sample.  The same figures go to a tab-separated file, one line per
+	benchmark, which a later run compares against with -c.
+
+	Build and run from src/:
+		make bench							# results in bin/bench.tsv
+		make bench BASE=old.tsv				# and compare with an earlier run
+
+	Or by hand:
+		bin/microbench [-c base.tsv] [results.tsv]
+
+	See the file LICENSE for license terms.
+
+***/
+#undef main			// the interpreter's main is renamed on the command line
+#include "bitlash.h"
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+void init_fake_eeprom(void);
+void init_millis(void);
+
+#define SAMPLES 10
+#define SAMPLENS 10e6			// calibrate each sample to this long
+
+double nanos(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9) + ts.tv_nsec;
+}
+
+void discard(byte c) {;}
+
+
+// lexing: tokens of a typical statement, without executing it
+char *lextext = "x = (y + 123) * max(4, 0x1f) - abs(z) % 7; if x >= 10 print \"big\", x";
+
+void lexbody(long n) {
+	while (n--) {
+		initparsepoint(SCRIPT_RAM, (numvar) lextext, 0);
+		do getsym(); while (CTX(sym) != s_eof);
+	}
+}
+
+int lextokens(void) {
+	int tokens = 0;
+	initparsepoint(SCRIPT_RAM, (numvar) lextext, 0);
+	do { getsym(); tokens++; } while (CTX(sym) != s_eof);
+	return tokens;
+}
+
+// task dispatch: claim and run one of TASKS due tasks
+#define TASKS 100
+
+void taskbody(long n) {
+	while (n--) {
+		int slot = claimTask();
+		if (slot >= 0) runTask(slot);
+	}
+}
+
+
+typedef struct {
+	const char *name;
+	char *script;				// run this once per execution, or
+	void (*body)(long);			// call this for n executions
+	int ops;					// operations per execution
+} benchmark;
+
+benchmark benchmarks[] = {
+	{ "lex (per token)",		0,	lexbody,	0 },
+	{ "empty statement",		";",	0,	1 },
+	{ "expression",				"x = (a + 3) * (b - 4) / 7 % 5 + (c << 2)",	0,	1 },
+	{ "assign and increment",	"x = 1; x++",	0,	1 },
+	{ "builtin call",			"x = max(a, b)",	0,	1 },
+	{ "eeprom function call",	"x = inc(3)",	0,	1 },
+	{ "file function call",		"x = fileinc(3)",	0,	1 },
+	{ "while (per iteration)",	"i = 0; while i < 100 {i++}",	0,	100 },
+	{ "switch",					"switch i % 3 {x = 1; x = 2; x = 3}; i++",	0,	1 },
+	{ "printf",					"printf(\"%d %s %x\\n\", 123, \"abc\", 255)",	0,	1 },
+	{ "task dispatch",			0,	taskbody,	1 },
+};
+#define NUMBENCH (int) (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+double runbench(benchmark *b, long n) {
+	double t0 = nanos();
+	if (b->body) (*b->body)(n);
+	else while (n--) execscript(SCRIPT_RAM, (numvar) b->script, 0);
+	return nanos() - t0;
+}
+
+typedef struct {
+	char name[40];
+	double mean, stddev, best;
+} result;
+
+// read the results of an earlier run
+int readresults(char *filename, result *results, int max) {
+	FILE *f = fopen(filename, "r");
+	if (!f) return -1;
+	char line[200];
+	int n = 0;
+	while ((n < max) && fgets(line, sizeof(line), f)) {
+		if (line[0] == '#') continue;
+		char *tab = strchr(line, '\t');
+		if (!tab) continue;
+		*tab = 0;
+		strncpy(results[n].name, line, sizeof(results[n].name) - 1);
+		results[n].name[sizeof(results[n].name) - 1] = 0;
+		if (sscanf(tab + 1, "%lf\t%lf\t%lf", &results[n].mean, &results[n].stddev, &results[n].best) == 3) n++;
+	}
+	fclose(f);
+	return n;
+}
+
+int main(int argc, char **argv) {
+	char *basefile = 0, *outfile = 0;
+	result base[NUMBENCH * 2];
+	int nbase = 0;
+	int i, s;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c") && (i + 1 < argc)) basefile = argv[++i];
+		else outfile = argv[i];
+	}
+	if (basefile) {
+		nbase = readresults(basefile, base, NUMBENCH * 2);
+		if (nbase < 0) {
+			fprintf(stderr, "cannot read %s\n", basefile);
+			return 1;
+		}
+	}
+
+	FILE *out = outfile ? fopen(outfile, "w") : 0;
+	if (outfile && !out) fprintf(stderr, "cannot write %s\n", outfile);
+	if (out) fprintf(out, "# benchmark\tns/op\tstddev %%\tbest ns/op\n");
+
+	// a scratch directory for the file function
+	char dir[] = "/tmp/microbench-XXXXXX";
+	if (!mkdtemp(dir) || chdir(dir)) {
+		fprintf(stderr, "cannot make a scratch directory\n");
+		return 1;
+	}
+	FILE *script = fopen("fileinc", "w");
+	if (script) {
+		fputs("return arg(1) + 1\n", script);
+		fclose(script);
+	}
+
+	init_fake_eeprom();
+	init_millis();
+	vinit();
+	initTaskList();
+	setOutputHandler(&discard);
+	doCommand("function inc {return arg(1) + 1}");
+	doCommand("function tick {t++}");
+	doCommand("a = 17; b = 42; c = 3; i = 0");
+	benchmarks[0].ops = lextokens();
+	for (i = 0; i < TASKS; i++) startTask(findKey("tick"), 0);
+
+	printf("%-24s %10s %8s %10s", "benchmark", "ns/op", "+/- %", "best");
+	if (basefile) printf(" %10s %8s", "base", "change");
+	printf("\n");
+
+	for (i = 0; i < NUMBENCH; i++) {
+		benchmark *b = &benchmarks[i];
+
+		// calibrate: double n until a sample takes long enough
+		long n = 1;
+		runbench(b, n);				// warm up
+		while ((runbench(b, n) < SAMPLENS) && (n < (1L << 30))) n *= 2;
+
+		double sum = 0, sumsq = 0, best = 0;
+		for (s = 0; s < SAMPLES; s++) {
+			double ns = runbench(b, n) / ((double) n * b->ops);
+			sum += ns;
+			sumsq += ns * ns;
+			if (!s || (ns < best)) best = ns;
+		}
+		double mean = sum / SAMPLES;
+		double var = (sumsq / SAMPLES) - (mean * mean);
+		double stddev = (var > 0) ? (100.0 * sqrt(var) / mean) : 0;
+
+		printf("%-24s %10.1f %8.1f %10.1f", b->name, mean, stddev, best);
+		if (basefile) {
+			int j;
+			for (j = 0; j < nbase; j++) if (!strcmp(base[j].name, b->name)) break;
+			if (j < nbase) printf(" %10.1f %+7.1f%%", base[j].mean, 100.0 * (mean - base[j].mean) / base[j].mean);
+		}
+		printf("\n");
+		if (out) fprintf(out, "%s\t%.2f\t%.2f\t%.2f\n", b->name, mean, stddev, best);
+	}
+	if (out) fclose(out);
+
+	unlink("fileinc");
+	if (chdir("/") == 0) rmdir(dir);
+	return 0;
+}
@@ -0,0 +1,206 @@
+/***
+	replaybench.c: workload replay benchmark for the Unix build
+
+	Loads each of the example scripts in bitlashcode/ into a fresh EEPROM,
+	starts its tasks the way you would at the console, and runs them on the
+	virtual clock for a fixed span of virtual time: each tick moves the clock
+	on to the next task due and runs every task due then.  Only ticks that
+	run a task are counted, since a run queue may stop the clock where
+	nothing is due, as the timer wheel does at a cascade.  Pins are the
+	Unix stubs, so a script can write and read them back, and output goes
+	nowhere.  For each workload, and all of them together, it reports task
+	runs and statements per second of real time.
+
+	The older scripts' name := "text" macros are loaded as functions.
+	elevator.btl is elevator2.btl as macros, and hello.btl and ledin.btl
+	(which uses the old colon syntax) are left out.
+
+	Build and run from src/:
+		make replaybench					# an hour of virtual time a workload
+		make replaybench SECONDS=86400
+
+	Or by hand:
+		bin/replaybench [virtual seconds] [script directory]
+
+	See the file LICENSE for license terms.
+
+***/
+#undef main			// the interpreter's main is renamed on the command line
+#include "bitlash.h"
+#include <time.h>
+
+#ifndef EXEC_STATS
+#error "build with -DEXEC_STATS, to count statements"
+#endif
+
+void init_fake_eeprom(void);
+void init_millis(void);
+extern byte virtualtime;
+extern unsigned long long virtualus;
+extern numvar vars[];
+
+double nanos(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9) + ts.tv_nsec;
+}
+
+void discard(byte c) {;}
+
+// a script file, and the commands that set it going
+typedef struct {
+	const char *name;
+	const char *file;
+	const char *start;			// commands, one per line
+} workload;
+
+workload workloads[] = {
+	{ "elevator",		"elevator2.btl",	"go" },
+	{ "trafficlight",	"trafficlight2.btl", "startup\nenable" },
+	{ "morse",			"morse.btl",		"startup\nbcn" },
+	{ "midi",			"midi.btl",			"startup\ngo" },
+	{ "servosequence",	"servosequence.btl", "function servo {aw(arg(1), arg(2))}\nstartup" },
+	{ "ledbargraph",	"ledbargraph.btl",	"setall(1)\nrun fliprun, 10\nrun setrnd, 25\nrun clk, 1000" },
+};
+#define NUMWORKLOADS (int) (sizeof(workloads) / sizeof(workloads[0]))
+
+// turn an old style macro, name := "text", into function name {text}
+// returns false if the line is something else
+int macrotofunction(char *line, char *function, int len) {
+	char *assign = strstr(line, ":=");
+	char *open = assign ? strchr(assign, '"') : 0;
+	char *close = open ? strrchr(open + 1, '"') : 0;
+	if (!close) return 0;
+	char *name = line, *end = assign;
+	while ((end > name) && ((end[-1] == ' ') || (end[-1] == '\t'))) end--;
+	int n = snprintf(function, len, "function %.*s {", (int) (end - name), name);
+	char *c = open + 1;
+	while ((c < close) && (n < len - 2)) {
+		if ((*c == '\\') && (c[1] == '"')) c++;		// \" is just " in braces
+		function[n++] = *c++;
+	}
+	function[n++] = '}';
+	function[n] = 0;
+	return 1;
+}
+
+// send each line of a script file as a command, as bloader.py does,
+// leaving out the comments and the lines between variants, and
+// converting the macros in the older scripts to functions
+int loadscript(const char *dir, const char *file) {
+	char path[256], line[256], function[300];
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	FILE *f = fopen(path, "r");
+	if (!f) return -1;
+	int lines = 0;
+	while (fgets(line, sizeof(line), f)) {
+		char *cmd = line;
+		while ((*cmd == ' ') || (*cmd == '\t')) cmd++;
+		cmd[strcspn(cmd, "\r\n")] = 0;
+		if (!*cmd || (*cmd == '#') || (*cmd == '-') || !strncmp(cmd, "//", 2)) continue;
+		if (macrotofunction(cmd, function, sizeof(function))) cmd = function;
+		doCommand(cmd);
+		lines++;
+	}
+	fclose(f);
+	return lines;
+}
+
+void runcommands(const char *commands) {
+	char buf[256];
+	strncpy(buf, commands, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	char *cmd = strtok(buf, "\n");
+	while (cmd) {
+		doCommand(cmd);
+		cmd = strtok(NULL, "\n");
+	}
+}
+
+typedef struct {
+	unsigned long ticks, runs, statements;
+	double ns;
+	unsigned long long virtualms;
+} replay;
+
+// run the tasks for seconds of virtual time
+void runfor(unsigned long seconds, replay *r) {
+	unsigned long long startus = virtualus;
+	unsigned long long endus = startus + (seconds * 1000000ULL);
+	unsigned long startstatements = sumstats()->statements;
+	double t0 = nanos();
+	while (virtualus < endus) {
+		long due = nextTaskDue();
+		if (due < 0) break;				// nothing left running
+		virtualus += due * 1000ULL;
+		if (virtualus > endus) virtualus = endus;
+		int runs = 0, slot;
+		while ((runs < 100) && ((slot = claimTask()) >= 0)) {	// as runDueTasks does
+			runTask(slot);
+			runs++;
+		}
+		if (runs) r->ticks++;
+		r->runs += runs;
+	}
+	r->ns = nanos() - t0;
+	r->statements = sumstats()->statements - startstatements;
+	r->virtualms = (virtualus - startus) / 1000;
+}
+
+void report(const char *name, int lines, replay *r) {
+	double secs = r->ns / 1e9;
+	char count[12] = "";
+	if (lines) snprintf(count, sizeof(count), "%d", lines);
+	printf("%-14s %6s %8lu %9lu %11lu %10llu %9.1f %11.0f %12.0f\n", name, count, r->ticks, r->runs,
+		r->statements, r->virtualms / 1000, r->ns / 1e6,
+		secs > 0 ? r->runs / secs : 0, secs > 0 ? r->statements / secs : 0);
+}
+
+int main(int argc, char **argv) {
+	unsigned long seconds = (argc > 1) ? strtoul(argv[1], NULL, 10) : 3600;
+	const char *dir = (argc > 2) ? argv[2] : "../bitlashcode";
+	replay total;
+	int i;
+
+	init_fake_eeprom();
+	init_millis();
+	vinit();
+	initTaskList();
+	setOutputHandler(&discard);
+	virtualtime = 1;
+	memset(&total, 0, sizeof(total));
+
+	printf("%lu virtual seconds a workload, scripts from %s\n", seconds, dir);
+	printf("%-14s %6s %8s %9s %11s %10s %9s %11s %12s\n", "workload", "lines", "ticks", "task runs",
+		"statements", "virtual s", "real ms", "runs/s", "statements/s");
+
+	for (i = 0; i < NUMWORKLOADS; i++) {
+		workload *w = &workloads[i];
+
+		// start from a clean slate: no tasks, no functions, variables zero
+		doCommand("stop *");
+		doCommand("rm *");
+		memset(vars, 0, 26 * sizeof(numvar));		// a through z
+		virtualus = 0;
+
+		int lines = loadscript(dir, w->file);
+		if (lines < 0) {
+			printf("%-14s cannot read %s/%s\n", w->name, dir, w->file);
+			continue;
+		}
+		runcommands(w->start);
+
+		replay r;
+		memset(&r, 0, sizeof(r));
+		runfor(seconds, &r);
+		report(w->name, lines, &r);
+
+		total.ticks += r.ticks;
+		total.runs += r.runs;
+		total.statements += r.statements;
+		total.ns += r.ns;
+		total.virtualms += r.virtualms;
+	}
+	report("all", 0, &total);
+	return 0;
+}
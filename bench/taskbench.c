@@ -0,0 +1,98 @@
+/***
+	taskbench.c: background task scheduling benchmark for the Unix build
+
+	Starts 1k, 10k and 100k periodic tasks running a one-statement function,
+	dispatches them for a second, and stops them, reporting the cost
+	per task of each step.  The dispatch figure has the cost of running
+	the function itself subtracted, so it is scheduler overhead.
+
+	Build and run from src/:
+		make taskbench						# run queue is the binary heap
+		make taskbench CFLAGS=-DTASK_WHEEL	# hierarchical timer wheel
+
+	See the file LICENSE for license terms.
+
+***/
+#undef main			// the interpreter's main is renamed on the command line
+#include "bitlash.h"
+#include <time.h>
+
+void init_fake_eeprom(void);
+void init_millis(void);
+
+double nanos(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9) + ts.tv_nsec;
+}
+
+void discard(byte c) {;}
+
+int main(int argc, char **argv) {
+	static const int sizes[] = { 1000, 10000, 100000 };
+	int i, n;
+
+	init_fake_eeprom();
+	init_millis();
+	vinit();
+	initTaskList();
+	setOutputHandler(&discard);
+	doCommand("function tick {x++}");
+	int macroid = findKey("tick");
+	numvar script = findend(macroid);
+
+	// cost of running the task body, to subtract below
+	double t0 = nanos();
+	for (i = 0; i < 100000; i++) execscript(SCRIPT_EEPROM, script, 0);
+	double bodyns = (nanos() - t0) / 100000;
+
+	printf("%s\n",
+#if defined(TASK_WHEEL)
+		"run queue: timer wheel");
+#else
+		"run queue: binary heap");
+#endif
+	printf("%8s %10s %12s %10s %10s %12s\n", "tasks", "start ns", "dispatch ns", "stop ns", "idle ns", "runs/sec");
+
+	for (n = 0; n < (int) (sizeof(sizes) / sizeof(sizes[0])); n++) {
+		int tasks = sizes[n];
+		initTaskList();
+		if (!setTaskLimit(tasks)) {
+			printf("out of memory at %d tasks\n", tasks);
+			return 1;
+		}
+
+		// periods from 1 ms to 1 s, so the tasks spread out over time
+		t0 = nanos();
+		for (i = 0; i < tasks; i++) startTask(macroid, 1 + ((i * 7919L) % 1000));
+		double startns = (nanos() - t0) / tasks;
+
+		// dispatch for one second, timing only the claims that found a task
+		long runs = 0;
+		double busy = 0;
+		t0 = nanos();
+		double stop = t0 + 1e9;
+		while (nanos() < stop) {
+			double t1 = nanos();
+			int slot = claimTask();
+			if (slot < 0) continue;
+			runTask(slot);
+			busy += nanos() - t1;
+			runs++;
+		}
+		double elapsed = nanos() - t0;
+		double dispatchns = runs ? (busy / runs) - bodyns : 0;
+
+		// cost of asking when the next task is due
+		t0 = nanos();
+		for (i = 0; i < 100000; i++) millisUntilNextTask();
+		double idlens = (nanos() - t0) / 100000;
+
+		t0 = nanos();
+		for (i = 0; i < tasks; i++) stopTask(i);
+		double stopns = (nanos() - t0) / tasks;
+
+		printf("%8d %10.1f %12.1f %10.1f %10.1f %12.0f\n", tasks, startns, dispatchns, stopns, idlens, runs / (elapsed / 1e9));
+	}
+	return 0;
+}
@@ -87,11 +87,18 @@ int getValue(char *key);			// return location of macro value in EEPROM or -1
 //	Add a user function to Bitlash
 //
 typedef numvar (*bitlash_function)(void);
-void addBitlashFunction(const char *, bitlash_function);
+int addBitlashFunction(const char *, bitlash_function);	// returns a function token, or -1 if the name is taken
 numvar getarg(numvar);
 numvar isstringarg(numvar);
 numvar getstringarg(numvar which);
 
+///////////////////////
+//	Background task table size (ARM only; AVR has a fixed table of 10)
+//
+#if !defined(__AVR__)
+byte setTaskLimit(int);				// returns false if out of memory or a task is running past the new size
+#endif
+
 ///////////////////////
 //	Serial Output Capture
 //
@@ -38,7 +38,9 @@
 
 // Exception handling state
 // Syntax and execution errors are handled via longjmp
+#if !defined(BITLASH_CONTEXT)
 jmp_buf env;
+#endif
 
 
 /////////
@@ -46,10 +48,101 @@ jmp_buf env;
 // doCommand: main entry point to execute a bitlash command
 //
 numvar doCommand(char *cmd) {
+#if defined(TASK_LATENCY)
+	if (CTX(fetchtype) == SCRIPT_NONE) {		// a command, not a call from a script
+		unsigned long start = micros();
+		numvar ret = execscript(SCRIPT_RAM, (numvar) cmd, 0);
+		commandLatency(micros() - start);
+		return ret;
+	}
+#endif
 	return execscript(SCRIPT_RAM, (numvar) cmd, 0);
 }
 
 
+#ifdef BITLASH_CONTEXT
+/////////
+//
+// Interpreter contexts: see bitlash.h
+//
+bitlash_ctx bitlash_main;
+__thread bitlash_ctx *bitlash_cur = &bitlash_main;
+
+#ifdef EXEC_STATS
+#include <pthread.h>
+
+// every context is on a list from bitlash_main, so the counts can be
+// added up; a freed context leaves its counts in retiredstats
+pthread_mutex_t ctxlock = PTHREAD_MUTEX_INITIALIZER;
+execstats retiredstats, totalstats;
+
+execstats *sumstats(void) {
+	pthread_mutex_lock(&ctxlock);
+	totalstats = retiredstats;
+	bitlash_ctx *ctx;
+	for (ctx = &bitlash_main; ctx; ctx = ctx->nextctx) addstats(&totalstats, &ctx->execcounts);
+	pthread_mutex_unlock(&ctxlock);
+	return &totalstats;
+}
+
+void clearstats(void) {
+	pthread_mutex_lock(&ctxlock);
+	memset(&retiredstats, 0, sizeof(retiredstats));
+	bitlash_ctx *ctx;
+	for (ctx = &bitlash_main; ctx; ctx = ctx->nextctx) memset(&ctx->execcounts, 0, sizeof(execstats));
+	pthread_mutex_unlock(&ctxlock);
+}
+#endif
+
+bitlash_ctx *bitlash_setctx(bitlash_ctx *ctx) {
+	bitlash_ctx *prev = bitlash_cur;
+	bitlash_cur = ctx;
+	return prev;
+}
+
+// returns NULL if out of memory
+bitlash_ctx *bitlash_ctx_new(void) {
+	bitlash_ctx *ctx = (bitlash_ctx *) calloc(1, sizeof(bitlash_ctx));
+	if (!ctx) return 0;
+	bitlash_ctx *prev = bitlash_setctx(ctx);
+	vinit();
+	bitlash_setctx(prev);
+#ifdef EXEC_STATS
+	pthread_mutex_lock(&ctxlock);
+	ctx->nextctx = bitlash_main.nextctx;
+	bitlash_main.nextctx = ctx;
+	pthread_mutex_unlock(&ctxlock);
+#endif
+	return ctx;
+}
+
+void bitlash_ctx_free(bitlash_ctx *ctx) {
+	if (!ctx || (ctx == &bitlash_main) || (ctx == bitlash_cur)) return;
+	bitlash_ctx *prev = bitlash_setctx(ctx);
+	vfree();
+	if (CTX(scriptfile_is_open)) fclose(CTX(scriptfile));
+	bitlash_setctx(prev);
+#ifdef EXEC_STATS
+	pthread_mutex_lock(&ctxlock);
+	bitlash_ctx *c = &bitlash_main;
+	while (c->nextctx != ctx) c = c->nextctx;
+	c->nextctx = ctx->nextctx;
+	addstats(&retiredstats, &ctx->execcounts);
+	pthread_mutex_unlock(&ctxlock);
+#endif
+	free(ctx);
+}
+
+// execute a command in the given context on this thread
+numvar bitlash_exec(bitlash_ctx *ctx, char *cmd) {
+	bitlash_ctx *prev = bitlash_setctx(ctx);
+	numvar ret = doCommand(cmd);
+	bitlash_setctx(prev);
+	return ret;
+}
+#endif
+
+
 void initBitlash(unsigned long baud) {
 
 #if defined(TINY_BUILD)
@@ -94,8 +94,8 @@ const prog_char *wordlist = builtin_table;
 		int result = strcmp_P(name, wordlist);
 		wordlist += strlen_P(wordlist) + 1;		// skip the name we just tested
 		if (!result) {							// got a match:
-			sym = s_script_progmem;				// set type to progmem script
-			symval = (numvar) wordlist;			// value is starting address of script text
+			CTX(sym) = s_script_progmem;				// set type to progmem script
+			CTX(symval) = (numvar) wordlist;			// value is starting address of script text
 			return 1;
 		}
 
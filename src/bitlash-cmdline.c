@@ -105,8 +105,11 @@ void initlbuf(void) {
 
 	prompt();
 	
+#if !defined(UNIX_BUILD)
 	// flush any pending serial input
+	// (on Unix, keep it: typed-ahead and piped input are expected to run)
 	while (serialAvailable()) serialRead();
+#endif
 }
 
 
@@ -124,8 +127,8 @@ byte putlbuf(char c) {
 }
 
 void pointToError(void) {
-	if (fetchtype == SCRIPT_RAM) {
-		int i = (char *) fetchptr - lbuf;
+	if (CTX(fetchtype) == SCRIPT_RAM) {
+		int i = (char *) CTX(fetchptr) - lbuf;
 		if ((i < 0) || (i >= LBUFLEN)) return;
 		speol();
 		while (i-- >= 0) spb('-');
@@ -199,6 +202,11 @@ void runBitlash(void) {
 	// Pipe the serial input into the command handler
 	if (serialAvailable()) doCharacter(serialRead());
 
+#if defined(TASK_PERSIST)
+	// the first time through, after setup() has added its functions
+	restoreTasks();
+#endif
+
 	// Background macro handler: feed it one call each time through
 	runBackgroundTasks();
 }
@@ -153,11 +153,12 @@ int erasestr(int addr) {
 void eraseentry(char *id) {
 	int entry = findKey(id);
 	if (entry >= 0) erasestr(erasestr(entry));
+	newdefinition();
 }
 
 // parsestring helpers
-void countByte(char c) { expval++; }
-void saveByte(char c) { eewrite(expval++, c); }
+void countByte(char c) { CTX(expval)++; }
+void saveByte(char c) { eewrite(CTX(expval)++, c); }
 
 
 
@@ -167,23 +168,23 @@ void cmd_function(void) {
 char id[IDLEN+1];			// buffer for id
 
 	getsym();				// eat "function", get putative id
-	if ((sym != s_undef) && (sym != s_script_eeprom) &&
-		(sym != s_script_progmem) && (sym != s_script_file)) unexpected(M_id);
-	strncpy(id, idbuf, IDLEN+1);	// save id string through value parse
+	if ((CTX(sym) != s_undef) && (CTX(sym) != s_script_eeprom) &&
+		(CTX(sym) != s_script_progmem) && (CTX(sym) != s_script_file)) unexpected(M_id);
+	strncpy(id, CTX(idbuf), IDLEN+1);	// save id string through value parse
 	eraseentry(id);
 	
 	getsym();		// eat the id, move on to '{'
 
-	if (sym != s_lcurly) expected(s_lcurly);
+	if (CTX(sym) != s_lcurly) expected(s_lcurly);
 
 	// measure the macro text using skipstatement
 	// fetchptr is on the character after '{'
 	//
 	// BUG: This is broken for file scripts
-	char *startmark = (char *) fetchptr;		// mark first char of macro text
+	char *startmark = (char *) CTX(fetchptr);		// mark first char of macro text
 	void skipstatement(void);
 	skipstatement();				// gobble it up without executing it
-	char *endmark = (char *) fetchptr;		// and note the char past '}'
+	char *endmark = (char *) CTX(fetchptr);		// and note the char past '}'
 
 	// endmark is past the closing '}' - back up and find it
 	do {
@@ -198,6 +199,7 @@ char id[IDLEN+1];			// buffer for id
 		while (startmark < endmark) eewrite(addr++, *startmark++);
 		eewrite(addr, 0);
 	}
+	newdefinition();
 
 	msgpl(M_saved);
 }
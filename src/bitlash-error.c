@@ -54,7 +54,7 @@ void fatal2(char msg1, char msg2) {
 	//traceback();
 
 	// Here we punt back to the setjmp in doCommand (bitlash.c)
-	longjmp(env, X_EXIT);
+	longjmp(CTX(env), X_EXIT);
 }
 
 void fatal(char msgid) { fatal2(msgid, 0); }
@@ -41,17 +41,14 @@
 #endif
 
 // 14772 vs 15022
-extern numvar *arg;
-#define arg1 arg[-1]
-#define arg2 arg[-2]
-#define arg3 arg[-3]
-#define arg4 arg[-4]
-#define arg5 arg[-5]
+#define arg1 CTX(arg)[-1]
+#define arg2 CTX(arg)[-2]
+#define arg3 CTX(arg)[-3]
+#define arg4 CTX(arg)[-4]
+#define arg5 CTX(arg)[-5]
 
-void reqargs(byte n) { if (arg[0] < n) missing(M_arg); }
-
-// this costs 500 bytes more!
-//#define reqargs(n) { if (arg[0] < n) missing(M_arg); }
+// Handlers do not check their argument count: dofunctioncall() checks it
+// against the minimum given in the BUILTIN_FUNCTIONS table below.
 
 ///////////////////////
 // FUNCTION HANDLERS
@@ -69,7 +66,6 @@ void make_beep(unumvar pin, unumvar frequency, unumvar duration) {
 }
 #else
 numvar func_beep(void) { 		// unumvar pin, unumvar frequency, unumvar duration)
-	reqargs(3);
 	unsigned long cycles = ((unsigned long) arg2 * (unsigned long) arg3) / 1000UL;
 	unsigned long halfperiod = (500000UL / (unsigned long) arg2) - 7UL;	// 7 fudge
 
@@ -117,7 +113,6 @@ static uint32_t deadbeef_seed = 0xbeefcafe;
 static uint32_t deadbeef_beef = 0xdeadbeef;
 numvar func_random(void) {
 unumvar ret;
-	reqargs(1);
 	deadbeef_seed = (deadbeef_seed << 7) ^ ((deadbeef_seed >> 25) + deadbeef_beef);
 	ret = ((numvar) deadbeef_seed & 0x7fffffff) % arg1;
 	deadbeef_beef = (deadbeef_beef << 7) ^ ((deadbeef_beef >> 25) + 0xdeadbeef);
@@ -148,49 +143,211 @@ void dbseed(uint32_t x) {
 //		>print inb(0x53)
 //		2
 //
-numvar func_inb(void) { reqargs(1); return *(volatile byte *) arg1; }
-numvar func_outb(void) { reqargs(2); *(volatile byte *) arg1 = (byte) arg2; return 0;}
-numvar func_abs(void) { reqargs(1); return arg1 < 0 ? -arg1 : arg1; }
+numvar func_inb(void) { return *(volatile byte *) arg1; }
+numvar func_outb(void) { *(volatile byte *) arg1 = (byte) arg2; return 0;}
+numvar func_abs(void) { return arg1 < 0 ? -arg1 : arg1; }
 numvar func_sign(void) {
-	reqargs(1);
 	if (arg1 < 0) return -1;
 	if (arg1 > 0) return 1;
 	return 0;
 }
-numvar func_min(void) { reqargs(2); return (arg1 < arg2) ? arg1 : arg2; }
-numvar func_max() { reqargs(2); return (arg1 > arg2) ? arg1 : arg2; }
+numvar func_min(void) { return (arg1 < arg2) ? arg1 : arg2; }
+numvar func_max() { return (arg1 > arg2) ? arg1 : arg2; }
 numvar func_constrain(void) {
-	reqargs(3);
 	if (arg1 < arg2) return arg2;
 	if (arg1 > arg3) return arg3;
 	return arg1;
 }
-numvar func_ar(void) { reqargs(1); return analogRead(arg1); }
-numvar func_aw(void) { reqargs(2); analogWrite(arg1, arg2); return 0; }
-numvar func_dr(void) { reqargs(1); return digitalRead(arg1); }
-numvar func_dw(void) { reqargs(2); digitalWrite(arg1, arg2); return 0; }
-numvar func_er(void) { reqargs(1); return eeread(arg1); }
-numvar func_ew(void) { reqargs(2); eewrite(arg1, arg2); return 0; }
-numvar func_pinmode(void) { reqargs(2); pinMode(arg1, arg2); return 0; }
-numvar func_pulsein(void) { reqargs(3); return pulseIn(arg1, arg2, arg3); }
-numvar func_snooze(void) { reqargs(1); snooze(arg1); return 0; }
-numvar func_delay(void) { reqargs(1); delay(arg1); return 0; }
+numvar func_ar(void) { return analogRead(arg1); }
+numvar func_aw(void) { analogWrite(arg1, arg2); return 0; }
+numvar func_dr(void) { return digitalRead(arg1); }
+numvar func_dw(void) { digitalWrite(arg1, arg2); return 0; }
+numvar func_er(void) { return eeread(arg1); }
+numvar func_ew(void) { eewrite(arg1, arg2); newdefinition(); return 0; }
+numvar func_pinmode(void) { pinMode(arg1, arg2); return 0; }
+numvar func_pulsein(void) { return pulseIn(arg1, arg2, arg3); }
+numvar func_snooze(void) { snooze(arg1); return 0; }
+numvar func_delay(void) {
+#ifdef TASK_COROUTINES
+	if (yieldTask(arg1)) return 0;		// a task sleeps without holding up the others
+#endif
+	delay(arg1);
+	return 0;
+}
 
 #if !defined(TINY_BUILD)
-numvar func_setBaud(void) { reqargs(2); setBaud(arg1, arg2); return 0; }
+numvar func_setBaud(void) { setBaud(arg1, arg2); return 0; }
 #endif
 
-//numvar func_map(void) { reqargs(5); return map(arg1, arg2, arg3, arg4, arg5); }
-//numvar func_shiftout(void) { reqargs(4); shiftOut(arg1, arg2, arg3, arg4); return 0; }
+#if defined(EXEC_STATS)
+//////////
+//
+//	stats: print the execution counters; stats(0) clears them
+//
+//	Tokens and bytes per statement show how much of the work is lexing
+//	script text, over again each time round a loop, rather than running it.
+//	Calls are counted by function, and the busiest TOPCALLS are listed.
+//
+#if !defined(BITLASH_CONTEXT)
+execstats execcounts;
+
+execstats *sumstats(void) { return &execcounts; }
+void clearstats(void) { memset(&execcounts, 0, sizeof(execcounts)); }
+#endif
 
-numvar func_bitclear(void) { reqargs(2); return arg1 & ~((numvar)1 << arg2); }
-numvar func_bitset(void) { reqargs(2); return arg1 | ((numvar)1 << arg2); }
-numvar func_bitread(void) { reqargs(2); return (arg1 & ((numvar)1 << arg2)) != 0; }
-numvar func_bitwrite(void) { reqargs(3); return arg3 ? func_bitset() : func_bitclear(); }
+// the entry for a function in calls, taking a free one if it has none
+// returns NULL if it has none and there are no free ones
+hotspot *findhotspot(hotspot *calls, byte type, char *name) {
+	unsigned int h = type;
+	char *c;
+	for (c = name; *c; c++) h = (h * 31) + *c;
+	int i = h % HOTSPOTS, n;
+	for (n = 0; n < HOTSPOTS; n++) {
+		hotspot *s = &calls[i];
+		if (!s->calls) {
+			strncpy(s->name, name, IDLEN);
+			s->name[IDLEN] = 0;
+			s->type = type;
+			return s;
+		}
+		if ((s->type == type) && !strcmp(s->name, name)) return s;
+		if (++i == HOTSPOTS) i = 0;
+	}
+	return 0;
+}
+
+// count a call to a function, in the running context
+void countcall(byte type, char *name) {
+	hotspot *s = findhotspot(CTX(execcounts).calls, type, name);
+	if (s) s->calls++;
+	else CTX(execcounts).othercalls++;
+}
+
+// add the counts in from to those in to
+void addstats(execstats *to, execstats *from) {
+	byte t;
+	int i;
+	to->statements += from->statements;
+	for (t = SCRIPT_NONE; t <= SCRIPT_FILE; t++) {
+		to->tokens[t] += from->tokens[t];
+		to->bytes[t] += from->bytes[t];
+		to->scriptcalls[t] += from->scriptcalls[t];
+	}
+	to->othercalls += from->othercalls;
+	for (i = 0; i < HOTSPOTS; i++) {
+		hotspot *s = &from->calls[i];
+		if (!s->calls) continue;
+		hotspot *d = findhotspot(to->calls, s->type, s->name);
+		if (d) d->calls += s->calls;
+		else to->othercalls += s->calls;
+	}
+}
+
+execstats *showing;				// the counts being printed
+
+void printcount(const char *label, unsigned long count) {
+	sp(label); printInteger(count, 10, ' ');
+}
+
+// n per statement, to a tenth
+void printperstmt(unsigned long n) {
+	unsigned long d = showing->statements ? showing->statements : 1;
+	unsigned long tenths = ((n * 10) + (d / 2)) / d;
+	printInteger(tenths / 10, 5, ' '); spb('.'); printInteger(tenths % 10, 0, ' ');
+	sp(" per statement");
+}
+
+// the breakdown by script type
+void printbytype(unsigned long *counts) {
+	static const char *types[] = { "none", "ram", "progmem", "eeprom", "file" };
+	byte t;
+	for (t = SCRIPT_NONE; t <= SCRIPT_FILE; t++) {
+		if ((t == SCRIPT_NONE) && !counts[t]) continue;
+		sp("  "); sp(types[t]); spb(' '); printInteger(counts[t], 0, ' ');
+	}
+	speol();
+}
+
+unsigned long sumbytype(unsigned long *counts) {
+	unsigned long sum = 0;
+	byte t;
+	for (t = SCRIPT_NONE; t <= SCRIPT_FILE; t++) sum += counts[t];
+	return sum;
+}
+
+// the busiest functions, most calls first
+#define TOPCALLS 10
+void printtopcalls(void) {
+	static const char *types[] = { "builtin", "ram", "progmem", "eeprom", "file", "c" };
+	unsigned long lastcalls = 0;
+	int last = -1, shown, i;
+	sp("busiest functions"); speol();
+	for (shown = 0; shown < TOPCALLS; shown++) {
+		// the next after last, in order of calls and then of slot
+		int best = -1;
+		for (i = 0; i < HOTSPOTS; i++) {
+			unsigned long calls = showing->calls[i].calls;
+			if (!calls) continue;
+			if ((last >= 0) && ((calls > lastcalls) || ((calls == lastcalls) && (i <= last)))) continue;
+			if ((best < 0) || (calls > showing->calls[best].calls)) best = i;
+		}
+		if (best < 0) break;
+		hotspot *s = &showing->calls[best];
+		printInteger(s->calls, 14, ' '); sp("  "); sp(types[s->type]); spb(' '); sp(s->name); speol();
+		last = best;
+		lastcalls = s->calls;
+	}
+	if (showing->othercalls) { printInteger(showing->othercalls, 14, ' '); sp("  others"); speol(); }
+}
+
+numvar func_stats(void) {
+	if ((getarg(0) > 0) && !arg1) {
+		clearstats();
+		return 0;
+	}
+	showing = sumstats();
+	unsigned long calls = showing->othercalls;
+	int i;
+	for (i = 0; i < HOTSPOTS; i++) calls += showing->calls[i].calls;
+	printcount("statements    ", showing->statements); speol();
+	printcount("function calls", calls); speol();
+	printcount("script calls  ", sumbytype(showing->scriptcalls)); printbytype(showing->scriptcalls);
+	unsigned long tokens = sumbytype(showing->tokens);
+	printcount("tokens        ", tokens); printperstmt(tokens); printbytype(showing->tokens);
+	unsigned long bytes = sumbytype(showing->bytes);
+	printcount("bytes         ", bytes); printperstmt(bytes); printbytype(showing->bytes);
+	printtopcalls();
+	return showing->statements;
+}
+#endif
+
+#if defined(TASK_LATENCY)
+//////////
+//
+//	lat: print the run time percentiles of commands and tasks; see showLatency()
+//	lat(0) clears them, and lat("file") writes the histograms to file
+//
+numvar func_lat(void) {
+	if (getarg(0) > 0) {
+		if (!arg1) clearLatency();
+		else return exportLatency((char *) arg1);
+	}
+	else showLatency();
+	return 0;
+}
+#endif
+
+//numvar func_map(void) { return map(arg1, arg2, arg3, arg4, arg5); }
+//numvar func_shiftout(void) { shiftOut(arg1, arg2, arg3, arg4); return 0; }
+
+numvar func_bitclear(void) { return arg1 & ~((numvar)1 << arg2); }
+numvar func_bitset(void) { return arg1 | ((numvar)1 << arg2); }
+numvar func_bitread(void) { return (arg1 & ((numvar)1 << arg2)) != 0; }
+numvar func_bitwrite(void) { return arg3 ? func_bitset() : func_bitclear(); }
 
 numvar func_getkey(void) {
 	if (getarg(0) > 0) sp((char *) getarg(1));
-	while (!serialAvailable()) {;}		// blocking!
+	waitForKey();
 	return (numvar) serialRead();
 }
 
@@ -198,7 +355,7 @@ numvar func_getnum(void) {
 	numvar num = 0;
 	if (getarg(0) > 0) sp((char *) getarg(1));
 	for (;;) {
-		while (!serialAvailable()) {;}	// blocking!
+		waitForKey();
 		int k = serialRead();
 		if ((k == '\r') || (k == '\n')) {
 			speol();
@@ -223,165 +380,98 @@ numvar func_getnum(void) {
 }
 
 //////////
-// Function name dictionary
+// Built-in function table
+//
+// Each built-in function is declared exactly once, below, with its name, 
+// the minimum number of arguments it requires, and its handler.  
+//
+// The list is expanded three times to generate the name dictionary, 
+// the table of minimum argument counts, and the handler table, so the three
+// are 1:1 by construction.
 //
-// Function dispatch is accomplished by looking up the proposed function name in this structure, 
-// which must be in ascending alphabetical order.
+// Function dispatch is accomplished by looking up the proposed function name
+// in the name dictionary; the index at which a matching function name is found 
+// is used to reference the other two tables.
 //
-// The index at which a matching function name is found is used to reference 
-// the function_table defined below to get the argument signature and C function 
-// address for the handler.
+// Entries declared with BF_TINY are included in the TINY_BUILD; entries declared
+// with BF are not.
 //
-//	MAINTENANCE NOTE: 	This dictionary must be sorted in alpha order 
-//						and must be 1:1 with function_table below.
+//	MAINTENANCE NOTE: 	This list must be sorted in alpha order by name.
 //
+#define BUILTIN_FUNCTIONS \
+	BF(		abs,		1,	func_abs) \
+	BF(		ar,			1,	func_ar) \
+	BF(		aw,			2,	func_aw) \
+	BF(		baud,		2,	func_setBaud) \
+	BF(		bc,			2,	func_bitclear) \
+	BF(		beep,		3,	func_beep) \
+	BF(		br,			2,	func_bitread) \
+	BF(		bs,			2,	func_bitset) \
+	BF(		bw,			3,	func_bitwrite) \
+	BF(		constrain,	3,	func_constrain) \
+	BF_TINY(delay,		1,	func_delay) \
+	BF(		dr,			1,	func_dr) \
+	BF(		dw,			2,	func_dw) \
+	BF(		er,			1,	func_er) \
+	BF(		ew,			2,	func_ew) \
+	BF_TINY(free,		0,	func_free) \
+	BF(		getkey,		0,	func_getkey) \
+	BF(		getnum,		0,	func_getnum) \
+	BF(		inb,		1,	func_inb) \
+	BF(		isstr,		1,	isstring) \
+	BF_LAT(	lat,		0,	func_lat) \
+	BF(		max,		2,	func_max) \
+	BF_TINY(millis,		0,	millis) \
+	BF(		min,		2,	func_min) \
+	BF(		outb,		2,	func_outb) \
+	BF_TINY(pinmode,	2,	func_pinmode) \
+	BF(		printf,		0,	func_printf) \
+	BF(		pulsein,	3,	func_pulsein) \
+	BF(		random,		1,	func_random) \
+	BF(		sign,		1,	func_sign) \
+	BF_TINY(snooze,		1,	func_snooze) \
+	BF_STATS(stats,		0,	func_stats)
+
+//	To add map() or shiftout(), uncomment their handlers above and add:
+//	BF(		map,		5,	func_map)
+//	BF(		shiftout,	4,	func_shiftout)
+
 #if defined(TINY_BUILD)
-const prog_char functiondict[] PROGMEM = {
-//	"abs\0"
-//	"ar\0"
-//	"aw\0"
-//	"baud\0"
-//	"bc\0"
-//	"beep\0"
-//	"br\0"
-//	"bs\0"
-//	"bw\0"
-//	"constrain\0"
-	"delay\0"
-//	"dr\0"
-//	"dw\0"
-//	"er\0"
-//	"ew\0"
-	"free\0"
-//	"inb\0"
-//	"map\0"
-//	"max\0"
-	"millis\0"
-//	"min\0"
-//	"outb\0"
-	"pinmode\0"
-//	"printf\0"
-//	"pulsein\0"
-//	"random\0"
-//	"shiftout\0"
-//	"sign\0"
-	"snooze\0"
-};
-
-#else		// standard function set
-
-const prog_char functiondict[] PROGMEM = {
-	"abs\0"
-	"ar\0"
-	"aw\0"
-	"baud\0"
-	"bc\0"
-	"beep\0"
-	"br\0"
-	"bs\0"
-	"bw\0"
-	"constrain\0"
-	"delay\0"
-	"dr\0"
-	"dw\0"
-	"er\0"
-	"ew\0"
-	"free\0"
-	"getkey\0"
-	"getnum\0"
-	"inb\0"
-	"isstr\0"
-//	"map\0"
-	"max\0"
-	"millis\0"
-	"min\0"
-	"outb\0"
-	"pinmode\0"
-	"printf\0"
-	"pulsein\0"
-	"random\0"
-//	"shiftout\0"
-	"sign\0"
-	"snooze\0"
-};
+#define BF_FULL(name, nargs, handler)
+#else
+#define BF_FULL(name, nargs, handler) BF_TINY(name, nargs, handler)
+#endif
+#define BF BF_FULL
+#if defined(EXEC_STATS)
+#define BF_STATS(name, nargs, handler) BF_TINY(name, nargs, handler)
+#else
+#define BF_STATS(name, nargs, handler)
+#endif
+#if defined(TASK_LATENCY)
+#define BF_LAT(name, nargs, handler) BF_TINY(name, nargs, handler)
+#else
+#define BF_LAT(name, nargs, handler)
 #endif
 
+// the name dictionary: "abs\0ar\0..."
+#define BF_TINY(name, nargs, handler) #name "\0"
+const prog_char functiondict[] PROGMEM = { BUILTIN_FUNCTIONS };
+#undef BF_TINY
 
+// minimum argument counts, checked in dofunctioncall()
+#define BF_TINY(name, nargs, handler) nargs,
+const prog_uchar function_nargs[] PROGMEM = { BUILTIN_FUNCTIONS };
+#undef BF_TINY
+
+// handlers
+#define BF_TINY(name, nargs, handler) (bitlash_function) handler,
+const bitlash_function function_table[] PROGMEM = { BUILTIN_FUNCTIONS };
+#undef BF_TINY
+
+#undef BF
+#undef BF_STATS
+#undef BF_LAT
 
-// function_table
-//
-// this must be 1:1 with the symbols above, which in turn must be in alpha order
-//
-#if defined(TINY_BUILD)
-const bitlash_function function_table[] PROGMEM = {
-//	func_abs,
-//	func_ar,
-//	func_aw,
-//	func_setBaud,
-//	func_bitclear,
-//	func_beep,
-//	func_bitread,
-//	func_bitset,
-//	func_bitwrite,
-//	func_constrain,
-	func_delay,
-//	func_dr,
-//	func_dw,
-//	func_er,
-//	func_ew,
-	func_free,
-//	func_inb,
-//	func_map,
-//	func_max,
-	(bitlash_function) millis,
-//	func_min,
-//	func_outb,
-	func_pinmode,
-//	func_printf,
-//	func_pulsein,
-//	func_random,
-//	func_shiftout,
-//	func_sign,
-	func_snooze 		// last one no comma!
- };
-
-#else		// standard function set
-
-const bitlash_function function_table[] PROGMEM = {
-	func_abs,
-	func_ar,
-	func_aw,
-	func_setBaud,
-	func_bitclear,
-	func_beep,
-	func_bitread,
-	func_bitset,
-	func_bitwrite,
-	func_constrain,
-	func_delay,
-	func_dr,
-	func_dw,
-	func_er,
-	func_ew,
-	func_free,
-	func_getkey,
-	func_getnum,
-	func_inb,
-	isstring,
-//	func_map,
-	func_max,
-	(bitlash_function) millis,
-	func_min,
-	func_outb,
-	func_pinmode,
-	func_printf,
-	func_pulsein,
-	func_random,
-//	func_shiftout,
-	func_sign,
-	func_snooze 		// last one no comma!
- };
-#endif
 
 // Enable USER_FUNCTIONS to include the add_bitlash_function() extension mechanism
 // This costs about 256 bytes
@@ -391,16 +481,70 @@ const bitlash_function function_table[] PROGMEM = {
 #endif
 
 #ifdef USER_FUNCTIONS
+
+// On AVR the user function table is a small fixed array searched linearly.
+// On Unix and ARM there is RAM to spare: the table grows on demand and
+// names are located through an open-addressed hash index.
+//
+#if !defined(AVR_BUILD)
+#define USER_FUNCTION_HASH
+#endif
+
+#ifdef USER_FUNCTION_HASH
+#define USER_FUNCTION_FLAG 0x4000		// token flag; the low bits are the table index
+#define USER_FUNCTION_MASK 0x3fff
+#define MIN_USER_FUNCTIONS 16			// initial table allocation; doubles as needed
+#else
 #define MAX_USER_FUNCTIONS 20		// increase this if needed, but keep free() > 200 ish
 #define USER_FUNCTION_FLAG 0x80
+#define USER_FUNCTION_MASK 0x7f
+#endif
 
 typedef struct {
 	const char *name;					// pointer to the name
 	bitlash_function func_ptr;	// pointer to the implementing function
 } user_functab_entry;
 
+#ifdef USER_FUNCTION_HASH
+int bf_install_count;			// number of installed functions
+int bf_table_size;				// allocated entries in user_functions
+user_functab_entry *user_functions;		// the table, grown with realloc
+
+// hash index: each slot holds a table index, or SLOT_EMPTY
+#define SLOT_EMPTY -1
+int *bf_hash;
+int bf_hash_size;				// always a power of two
+
+unsigned int bf_hashname(const char *name) {
+unsigned int h = 5381;
+	while (*name) h = (h * 33) ^ (byte) *name++;
+	return h;
+}
+
+// return the hash slot holding name, or the empty slot where it belongs
+int bf_findslot(const char *name) {
+	int slot = bf_hashname(name) & (bf_hash_size - 1);
+	while ((bf_hash[slot] != SLOT_EMPTY) && strcmp(name, user_functions[bf_hash[slot]].name))
+		slot = (slot + 1) & (bf_hash_size - 1);
+	return slot;
+}
+
+// double the hash index and re-insert every installed function
+void bf_rehash(void) {
+int i;
+	int newsize = bf_hash_size ? (bf_hash_size << 1) : (MIN_USER_FUNCTIONS << 1);
+	int *newhash = (int *) malloc(newsize * sizeof(int));
+	if (!newhash) overflow(M_functions);
+	free(bf_hash);
+	bf_hash = newhash;
+	bf_hash_size = newsize;
+	for (i=0; i < bf_hash_size; i++) bf_hash[i] = SLOT_EMPTY;
+	for (i=0; i < bf_install_count; i++) bf_hash[bf_findslot(user_functions[i].name)] = i;
+}
+#else
 byte bf_install_count;			// number of installed functions
 user_functab_entry user_functions[MAX_USER_FUNCTIONS];		// the table
+#endif
 
 
 //////////
@@ -408,12 +552,17 @@ user_functab_entry user_functions[MAX_USER_FUNCTIONS];		// the table
 //
 //
 //	name: Pointer to a string containing the name for the function, like "myfunc".
+//		The name is not copied, so it must stay put for the life of the program.
 //
-//		Note: Since the user table is searched last, attempting to redefine an 
-//		existing function will fail silently, leading to interesting debugging experience.
+//		Note: Since the user table is searched after the built-in functions, a name
+//		that is already taken is reported and not installed.
 //
 //	func_ptr: pointer to the implementing C function
 //
+//	Returns the function's token, which stays valid for the life of the program
+//	and may be passed to dofunctioncall() without looking the name up again, 
+//	or FAIL if the name is already taken.
+//
 //	if it weren't built-in, you could add millis() like this:
 //		addBitlashFunction("millis", (bitlash_function) millis);
 //
@@ -430,11 +579,41 @@ user_functab_entry user_functions[MAX_USER_FUNCTIONS];		// the table
 //		> print foo(22,33)
 //		148
 //
-void addBitlashFunction(const char *name, bitlash_function func_ptr) {
+int addBitlashFunction(const char *name, bitlash_function func_ptr) {
+	numvar thesymval = CTX(symval);		// the lookups below clobber symval
+	// any name resolveid() finds first would hide it
+	byte taken = findindex((char *) name, (const prog_char *) reservedwords, 1) ||
+		findindex((char *) name, (const prog_char *) functiondict, 1) || 
+#ifdef LONG_ALIASES
+		findindex((char *) name, (const prog_char *) aliasdict, 0) ||
+#endif
+		find_user_function((char *) name);
+	CTX(symval) = thesymval;
+	if (taken) {
+		sp(name); spb(' '); msgpl(M_dup);
+		return FAIL;
+	}
+
+#ifdef USER_FUNCTION_HASH
+	if (bf_install_count >= USER_FUNCTION_MASK) overflow(M_functions);
+	if (bf_install_count >= bf_table_size) {
+		int newsize = bf_table_size ? (bf_table_size << 1) : MIN_USER_FUNCTIONS;
+		user_functab_entry *newtable = (user_functab_entry *) 
+			realloc(user_functions, newsize * sizeof(user_functab_entry));
+		if (!newtable) overflow(M_functions);
+		user_functions = newtable;
+		bf_table_size = newsize;
+	}
+	// keep the index at most half full so probe chains stay short
+	if ((bf_install_count + 1) * 2 > bf_hash_size) bf_rehash();
+	bf_hash[bf_findslot(name)] = bf_install_count;
+#else
 	if (bf_install_count >= MAX_USER_FUNCTIONS) overflow(M_functions);
+#endif
 	user_functions[bf_install_count].name = name;
 	user_functions[bf_install_count].func_ptr = func_ptr;	
-	bf_install_count++;
+	newdefinition();
+	return bf_install_count++ | USER_FUNCTION_FLAG;
 }
 
 //////////
@@ -442,15 +621,23 @@ void addBitlashFunction(const char *name, bitlash_function func_ptr) {
 // return true if found, with the user function token in symval (with USER_FUNCTION_FLAG set)
 //
 char find_user_function(char *id) {
-	symval = 0;
-	while (symval < bf_install_count) {
-		if (!strcmp(id, user_functions[symval].name)) {
-			symval |= USER_FUNCTION_FLAG;
+#ifdef USER_FUNCTION_HASH
+	if (!bf_install_count) return 0;
+	int slot = bf_findslot(id);
+	if (bf_hash[slot] == SLOT_EMPTY) return 0;
+	CTX(symval) = bf_hash[slot] | USER_FUNCTION_FLAG;
+	return 1;
+#else
+	CTX(symval) = 0;
+	while (CTX(symval) < bf_install_count) {
+		if (!strcmp(id, user_functions[CTX(symval)].name)) {
+			CTX(symval) |= USER_FUNCTION_FLAG;
 			return 1;
 		}
-		symval++;
+		CTX(symval)++;
 	}
 	return 0;
+#endif
 }
 
 //////////
@@ -458,7 +645,7 @@ char find_user_function(char *id) {
 // show_user_functions: display a list of registered user functions
 //
 void show_user_functions(void) {
-byte i;
+int i;
 	for (i=0; i < bf_install_count; i++) {
 		sp(user_functions[i].name);
 		spb(' ');
@@ -475,25 +662,31 @@ byte i;
 // parse the argument list, marshall the arguments and call the function,
 // and push its return value, if any, on the value stack
 //
-void dofunctioncall(byte entry) {
+void dofunctioncall(int entry) {
 bitlash_function fp;
-
+byte nargs = 0;			// minimum argument count; user functions check their own
 #ifdef USER_FUNCTIONS
 	// Detect and handle a user function: its id has the high bit set
-	// we set nargs and fp and fall through to masquerade as a built-in
+	// we set fp and fall through to masquerade as a built-in
 	if (entry & USER_FUNCTION_FLAG) {
-		fp = (bitlash_function) user_functions[entry & 0x7f].func_ptr;
+		countcall(SCRIPT_FUNCTION, CTX(idbuf));
+		fp = (bitlash_function) user_functions[entry & USER_FUNCTION_MASK].func_ptr;
 	}
 	else
 #endif
 	// built-in function
+	{
+		countcall(CALL_BUILTIN, CTX(idbuf));
 #ifdef UNIX_BUILD
-	fp = function_table[entry];
+		fp = function_table[entry];
 #else
-	fp = (bitlash_function) pgm_read_word(&function_table[entry]);
+		fp = (bitlash_function) pgm_read_word(&function_table[entry]);
 #endif
+		nargs = pgm_read_byte(&function_nargs[entry]);
+	}
 
-	parsearglist();			// parse the arguments
+	parsearglist(0);		// parse the arguments into an unnamed frame
+	if (argcount(CTX(arg)) < nargs) missing(M_arg);
 	numvar ret = (*fp)();	// call the function 
 	releaseargblock();		// peel off the arguments
 	vpush(ret);				// and push the return value
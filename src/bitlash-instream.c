@@ -63,6 +63,22 @@ byte scriptfileexists(char *scriptname) { return 0; }
 void initparsepoint(byte scripttype, numvar scriptaddress, char *scriptname);
 
 
+#if defined(TASK_TABLE)
+/////////
+//
+// Call a built-in or user C function that is run as a task, with no arguments.
+// It runs from an empty script, so that a script it runs in turn does not 
+// take over the error recovery point.
+//
+numvar calltaskfunction(int entry) {
+	initparsepoint(SCRIPT_RAM, (numvar) "", 0);
+	getsym();					// s_eof, so the argument list is empty
+	dofunctioncall(entry);
+	return vpop();
+}
+#endif
+
+
 /////////
 //
 //	Parse and interpret a stream, and return its value
@@ -77,18 +93,18 @@ numvar execscript(byte scripttype, numvar scriptaddress, char *scriptname) {
 	// save parse context
 	parsepoint fetchmark;
 	markparsepoint(&fetchmark);
-	byte thesym = sym;
-	vpush(symval);
+	byte thesym = CTX(sym);
+	vpush(CTX(symval));
 
 	// if this is the first stream context in this invocation,
 	// set up our error recovery point and init the value stack
 	// otherwise we skip this to allow nested execution calls 
 	// to properly return to top
 	//
-	if (fetchtype == SCRIPT_NONE) {
+	if (CTX(fetchtype) == SCRIPT_NONE) {
 
 		// Exceptions come here via longjmp; see bitlash-error.c
-		switch(setjmp(env)) {
+		switch(setjmp(CTX(env))) {
 			case 0: break;
 			case X_EXIT: {
 
@@ -115,30 +131,50 @@ numvar execscript(byte scripttype, numvar scriptaddress, char *scriptname) {
 #endif
 				// Other cleanups here
 				vinit();			// initialize the expression stack
-				fetchtype = SCRIPT_NONE;	// reset parse context
-				fetchptr = 0L;				// reset parse location
+				CTX(fetchtype) = SCRIPT_NONE;	// reset parse context
+				CTX(fetchptr) = 0L;				// reset parse location
 				// sd_up = 0;				// TODO: reset file system
 				return (numvar) -1;
 			}							// X_EXIT case
+#if defined(TASK_TABLE)
+			case X_BUDGET: {
+				// a task ran over its budget: end this run only, and leave
+				// the task to be rescheduled like any other
+				vinit();
+				CTX(fetchtype) = SCRIPT_NONE;
+				CTX(fetchptr) = 0L;
+				return (numvar) -1;
+			}
+#endif
 		}								// switch
+
+#ifdef CALL_CACHE
+		reclaimliterals();			// no argblocks are live at the top
+#endif
 	}
-	initparsepoint(scripttype, scriptaddress, scriptname);
-	getsym();
+	numvar ret;
+#if defined(TASK_TABLE)
+	if (scripttype == SCRIPT_FUNCTION) ret = calltaskfunction((int) scriptaddress);
+	else
+#endif
+	{
+		initparsepoint(scripttype, scriptaddress, scriptname);
+		getsym();
 
-	// interpret the function text and collect its result
-	numvar ret = getstatementlist();
+		// interpret the function text and collect its result
+		ret = getstatementlist();
+	}
 	returntoparsepoint(&fetchmark, 1);		// now where were we?
-	sym = thesym;
-	symval = vpop();
+	CTX(sym) = thesym;
+	CTX(symval) = vpop();
 	return ret;
 }
 
 
 // how to access the calling and called function names
 //
-//#define callername ((char *) ((numvar *) arg[2]) [1])
-#define callername (arg[2] ? (char* ) (((numvar *) arg[2]) [1]) : NULL )
-#define calleename ((char *) arg[1]) 
+#define callername (argparent(CTX(arg)) ? argname(argparent(CTX(arg))) : NULL)
+#define calleename argname(CTX(arg))
 
 
 /////////
@@ -146,17 +182,20 @@ numvar execscript(byte scripttype, numvar scriptaddress, char *scriptname) {
 // Call a Bitlash script function and push its return value on the stack
 //
 void callscriptfunction(byte scripttype, numvar scriptaddress) {
+	countstat(scriptcalls[scripttype]);
+	countcall(scripttype, CTX(idbuf));
 
 	// note on function name management
 	//
 	// we get here with the name of the function we want to call in global idbuf.
-	// parsearglist() pushes a copy of idbuf into the string pool, so
-	// the function's name is the first data in the string pool slab
-	// that will be deallocated when the function returns
+	// parsearglist() records the name in the new frame: an interned copy, or 
+	// on AVR a copy at the start of the frame's string pool slab that will be 
+	// deallocated when the function returns
 	//
-	// we can refer to this copy of the function's name via the callername macro
+	// we can refer to the function's name via the calleename macro,
+	// and to our caller's via the callername macro
 	//
-	parsearglist();
+	parsearglist(1);
 	numvar ret = execscript(scripttype, scriptaddress, calleename);
 	releaseargblock();
 	vpush(ret);
@@ -175,20 +214,20 @@ void callscriptfunction(byte scripttype, numvar scriptaddress) {
 void markparsepoint(parsepoint *p) {
 
 #if defined(SDFILE) || defined(UNIX_BUILD)
-	if (fetchtype == SCRIPT_FILE) {
+	if (CTX(fetchtype) == SCRIPT_FILE) {
 		// the location we wish to return to is the point from which we read inchar, 
 		// which is one byte before the current file pointer since it auto-advances
-		fetchptr = scriptgetpos() - 1;
+		CTX(fetchptr) = scriptgetpos() - 1;
 	}
 #endif
 
-	p->fetchptr = fetchptr;
-	p->fetchtype = fetchtype;
+	p->ptr = CTX(fetchptr);
+	p->type = CTX(fetchtype);
 
 #ifdef PARSER_TRACE
 	if (trace) {
 		speol();	
-		sp("mark:");printHex(fetchtype); spb(' '); printHex(fetchptr); 
+		sp("mark:");printHex(CTX(fetchtype)); spb(' '); printHex(CTX(fetchptr)); 
 		speol();
 	}
 #endif
@@ -206,16 +245,16 @@ void initparsepoint(byte scripttype, numvar scriptaddress, char *scriptname) {
 	}
 #endif
 
-	fetchtype = scripttype;
-	fetchptr = scriptaddress;
+	CTX(fetchtype) = scripttype;
+	CTX(fetchptr) = scriptaddress;
 	
 	// if we're restoring to idle, we're done
-	if (fetchtype == SCRIPT_NONE) return;
+	if (CTX(fetchtype) == SCRIPT_NONE) return;
 
 #if defined(SDFILE) || defined(UNIX_BUILD)
 	// handle file transition side effects here, once per transition,
 	// rather than once per character below in primec()
-	if (fetchtype == SCRIPT_FILE) {
+	if (CTX(fetchtype) == SCRIPT_FILE) {
 
 #if defined(UNIX_BUILD)
 		// ask the file glue to open and position the file for us
@@ -238,20 +277,20 @@ char *topname = ".top.";
 
 void returntoparsepoint(parsepoint *p, byte returntoparent) {
 	// restore parse type and location; for script files, pass name from string pool
-	byte ftype = p->fetchtype;
+	byte ftype = p->type;
 	char *scriptname = calleename;
 	if (returntoparent) {
 		if ((ftype == SCRIPT_NONE) || (ftype == SCRIPT_RAM))
 			scriptname = topname;
-		else if (arg[2]) scriptname = callername;
+		else if (callername) scriptname = callername;
 	}
-	initparsepoint(p->fetchtype, p->fetchptr, scriptname);
+	initparsepoint(p->type, p->ptr, scriptname);
 
 #ifdef PARSER_TRACE
 	if (trace) {
 		speol();
 		sp("rest:");
-		printHex(fetchtype); spb(' '); printHex(fetchptr); spb(' ');printHex(returntoparent);
+		printHex(CTX(fetchtype)); spb(' '); printHex(CTX(fetchptr)); spb(' ');printHex(returntoparent);
 		speol();
 	}
 #endif
@@ -262,7 +301,7 @@ void returntoparsepoint(parsepoint *p, byte returntoparent) {
 
 void returntoparsepoint(parsepoint *p, byte returntoparent) {
 	// restore parse type and location; for script files, pass name from string pool
-	initparsepoint(p->fetchtype, p->fetchptr, returntoparent ? callername : calleename);
+	initparsepoint(p->type, p->ptr, returntoparent ? callername : calleename);
 }
 #endif
 
@@ -275,12 +314,12 @@ void returntoparsepoint(parsepoint *p, byte returntoparent) {
 //		and set inchar to the character found there
 //
 void fetchc(void) {
-	++fetchptr;
+	++CTX(fetchptr);
 
 #ifdef PARSER_TRACE
 	if (trace) {
 		spb('[');
-		printHex(fetchptr);
+		printHex(CTX(fetchptr));
 		spb(']');
 	}
 #endif
@@ -296,23 +335,24 @@ void fetchc(void) {
 //		set inchar to the character or zero on EOF
 //
 void primec(void) {
-	switch (fetchtype) {
-		case SCRIPT_RAM:		inchar = *(char *) fetchptr;		break;
-		case SCRIPT_PROGMEM:	inchar = pgm_read_byte(fetchptr); 	break;
-		case SCRIPT_EEPROM:		inchar = eeread((int) fetchptr);	break;
+	switch (CTX(fetchtype)) {
+		case SCRIPT_RAM:		CTX(inchar) = *(char *) CTX(fetchptr);		break;
+		case SCRIPT_PROGMEM:	CTX(inchar) = pgm_read_byte(CTX(fetchptr)); 	break;
+		case SCRIPT_EEPROM:		CTX(inchar) = eeread((int) CTX(fetchptr));	break;
 
 #if defined(SDFILE) || defined(UNIX_BUILD)
-		case SCRIPT_FILE:		inchar = scriptread();				break;
+		case SCRIPT_FILE:		CTX(inchar) = scriptread();				break;
 #endif
 
 		default:				unexpected(M_oops);
 	}
+	countstat(bytes[CTX(fetchtype)]);
 
 #ifdef PARSER_TRACE
 	if (trace) {
 		spb('<'); 
-		if (inchar >= 0x20) spb(inchar);
-		else { spb('\\'); printInteger(inchar, 0, ' '); }
+		if (CTX(inchar) >= 0x20) spb(CTX(inchar));
+		else { spb('\\'); printInteger(CTX(inchar), 0, ' '); }
 		spb('>');
 	}
 #endif
@@ -325,10 +365,10 @@ void primec(void) {
 //	Print traceback
 //
 void traceback(void) {
-numvar *a = arg;
+numvar *a = CTX(arg);
 	while (a) {
-		sp((char *) (a[1])); speol();
-		a = (numvar *) (a[2]);
+		if (argname(a)) { sp(argname(a)); speol(); }
+		a = argparent(a);
 	}
 }
 
@@ -344,9 +384,9 @@ numvar sdcat(void) {
 	parsepoint fetchmark;
 	markparsepoint(&fetchmark);
 	initparsepoint(SCRIPT_FILE, 0L, (char *) getarg(1));
-	while (inchar) {
-		if (inchar == '\n') spb('\r');
-		spb(inchar);
+	while (CTX(inchar)) {
+		if (CTX(inchar) == '\n') spb('\r');
+		spb(CTX(inchar));
 		fetchc();
 	}
 	returntoparsepoint(&fetchmark, 1);
@@ -365,6 +405,7 @@ numvar sdwrite(char *filename, char *contents, byte append) {
 #endif
 
 	if (!scriptwrite(filename, contents, append)) unexpected(M_oops);
+	newdefinition();		// a new file may shadow a built-in script
 
 #if !defined(UNIX_BUILD)
 	returntoparsepoint(&fetchmark, 1);
@@ -383,6 +424,7 @@ numvar func_fprintf(void) {
 	markparsepoint(&fetchmark);
 
 	scriptwrite((char *) getarg(1), "", 1);		// open the file for append (but append nothing)
+	newdefinition();
 
 	//serialOutputFunc saved_handler = serial_override_handler;	// save previous output handler
 	void scriptwritebyte(byte);
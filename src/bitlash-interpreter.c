@@ -44,7 +44,7 @@
 int gethex(byte count) {
 int value = 0;
 	while (count--) {
-		value = (value << 4) + hexval(inchar);
+		value = (value << 4) + hexval(CTX(inchar));
 		fetchc();
 	}
 	return value;
@@ -59,6 +59,7 @@ void nukeeeprom(void) {
 		if (eeread(addr) != EMPTY) eewrite(addr, EMPTY);
 		addr++;
 	}
+	newdefinition();
 }
 
 
@@ -116,34 +117,34 @@ signed char nestlevel = 0;
 
 	// Skip a statement list in curly braces: { stmt; stmt; stmt; }
 	// Eat until the matching s_rcurly
-	if (sym == s_lcurly) {
+	if (CTX(sym) == s_lcurly) {
 		getsym();	// eat "{"
-		while (sym != s_eof) {
-			if (sym == s_lcurly) ++nestlevel;
-			else if (sym == s_rcurly) {
+		while (CTX(sym) != s_eof) {
+			if (CTX(sym) == s_lcurly) ++nestlevel;
+			else if (CTX(sym) == s_rcurly) {
 				if (nestlevel <= 0) {
 					getsym(); 	// eat "}"
 					break;
 				}
 				else --nestlevel;
 			}
-			else if (sym == s_quote) parsestring(&skipbyte);
+			else if (CTX(sym) == s_quote) parsestring(&skipbyte);
 			getsym();
 		}
 	}
 
 	// skipping the if statement is a little tricky; same for switch
-	else if ((sym == s_if) || (sym == s_switch)) {
+	else if ((CTX(sym) == s_if) || (CTX(sym) == s_switch)) {
 
 		// find ';', '{', or end
-		while ((sym != s_eof) && (sym != s_semi) && (sym != s_lcurly)) getsym();
+		while ((CTX(sym) != s_eof) && (CTX(sym) != s_semi) && (CTX(sym) != s_lcurly)) getsym();
 
-		if (sym == s_eof) return;
-		else if (sym == s_lcurly) skipstatement();	// eat an if-true {statementlist;}
+		if (CTX(sym) == s_eof) return;
+		else if (CTX(sym) == s_lcurly) skipstatement();	// eat an if-true {statementlist;}
 		else getsym();								// ate the statement; eat the ';'
 
 		// now handle the optional 'else' part
-		if (sym == s_else) {
+		if (CTX(sym) == s_else) {
 			getsym();			// eat 'else'
 			skipstatement();	// skip one statement and we're done
 		}
@@ -153,19 +154,19 @@ signed char nestlevel = 0;
 	// eat until semicolon or ')'
 	// ignoring embedded argument lists
 	else {
-		while (sym != s_eof) {
-			if (sym == s_lparen) ++nestlevel;
-			else if (sym == s_rparen) {
+		while (CTX(sym) != s_eof) {
+			if (CTX(sym) == s_lparen) ++nestlevel;
+			else if (CTX(sym) == s_rparen) {
 				if (nestlevel <= 0) {
 					getsym();
 					break;
 				}
 				else --nestlevel;
 			}
-			else if (sym == s_quote) parsestring(&skipbyte);
+			else if (CTX(sym) == s_quote) parsestring(&skipbyte);
 			else if (nestlevel == 0) {
 				//if ((sym == s_semi) || (sym == s_comma)) {
-				if (sym == s_semi) {
+				if (CTX(sym) == s_semi) {
 					getsym();	// eat ";"
 					break;
 				}
@@ -184,41 +185,51 @@ signed char nestlevel = 0;
 numvar getstatement(void);
 
 
+#if defined(TASK_TABLE)
+// Is the current symbol the word w?  Modifiers like the ones after run are
+// not reserved words, so they can still be used as function names.
+byte isword(const char *w) {
+	return ((CTX(sym) == s_undef) || (CTX(sym) == s_script_eeprom) || (CTX(sym) == s_script_progmem) ||
+		(CTX(sym) == s_script_file) || (CTX(sym) == s_nfunct)) && !strcmp(CTX(idbuf), w);
+}
+#endif
+
+
 // The switch statement: execute one of N statements based on a selector value
 // switch <numval> { stmt0; stmt1;...;stmtN }
 // numval < 0: treated as numval == 0
 // numval > N: treated as numval == N
 //
 numvar getswitchstatement(void) {
-numvar thesymval = symval;
+numvar thesymval = CTX(symval);
 numvar retval = 0;
-byte thesym = sym;
+byte thesym = CTX(sym);
 parsepoint fetchmark;
 
 	getsym();						// eat "switch"
 	getnum();						// evaluate the switch selector
-	if (expval < 0) expval = 0;		// map negative values to zero
-	byte which = (byte) expval;		// and stash it for reference
-	if (sym != s_lcurly) expectedchar('{');
+	if (CTX(expval) < 0) CTX(expval) = 0;		// map negative values to zero
+	byte which = (byte) CTX(expval);		// and stash it for reference
+	if (CTX(sym) != s_lcurly) expectedchar('{');
 	getsym();		// eat "{"
 
 	// we sit before the first statement
 	// scan and discard the <selector>'s worth of statements 
 	// that sit before the one we want
-	while ((which > 0) && (sym != s_eof) && (sym != s_rcurly)) {
+	while ((which > 0) && (CTX(sym) != s_eof) && (CTX(sym) != s_rcurly)) {
 		markparsepoint(&fetchmark);
-		thesym = sym;
-		thesymval = symval;
+		thesym = CTX(sym);
+		thesymval = CTX(symval);
 		skipstatement();
-		if ((sym != s_eof) && (sym != s_rcurly)) --which;
+		if ((CTX(sym) != s_eof) && (CTX(sym) != s_rcurly)) --which;
 	}
 
 	// If the selector is greater than the number of statements,
 	// back up and execute the last one
 	if (which > 0) {					// oops ran out of piddys
 		returntoparsepoint(&fetchmark, 0);
-		sym = thesym;
-		symval = thesymval;
+		CTX(sym) = thesym;
+		CTX(symval) = thesymval;
 	}
 	//unexpected(M_number);
 
@@ -226,8 +237,8 @@ parsepoint fetchmark;
 	retval = getstatement();
 
 	// eat the rest of the statement block to "}"
-	while ((sym != s_eof) && (sym != s_rcurly)) skipstatement();
-	if (sym == s_rcurly) getsym();		// eat "}"
+	while ((CTX(sym) != s_eof) && (CTX(sym) != s_rcurly)) skipstatement();
+	if (CTX(sym) == s_rcurly) getsym();		// eat "}"
 	return retval;
 }
 
@@ -235,12 +246,16 @@ parsepoint fetchmark;
 // Get a statement
 numvar getstatement(void) {
 numvar retval = 0;
+	countstat(statements);
 
-#if !defined(TINY_BUILD) && !defined(UNIX_BUILD)
+#if !defined(TINY_BUILD)
 	chkbreak();
 #endif
+#if defined(TASK_TABLE)
+	if (CTX(budgeted)) chkbudget();
+#endif
 
-	if (sym == s_while) {
+	if (CTX(sym) == s_while) {
 		// at this point sym is pointing at s_while, before the conditional expression
 		// save fetchptr so we can restart parsing from here as the while iterates
 		parsepoint fetchmark;
@@ -250,7 +265,7 @@ numvar retval = 0;
 			getsym(); 						// fetch the start of the conditional
 			if (getnum()) {
 				retval = getstatement();
-				if (sym == s_returning) break;	// exit if we caught a return
+				if (CTX(sym) == s_returning) break;	// exit if we caught a return
 			}
 			else {
 				skipstatement();
@@ -259,92 +274,195 @@ numvar retval = 0;
 		}
 	}
 	
-	else if (sym == s_if) {
+	else if (CTX(sym) == s_if) {
 		getsym();			// eat "if"
 		if (getnum()) {
 			retval = getstatement();
-			if (sym == s_else) {
+			if (CTX(sym) == s_else) {
 				getsym();	// eat "else"
 				skipstatement();
 			}
 		} else {
 			skipstatement();
-			if (sym == s_else) {
+			if (CTX(sym) == s_else) {
 				getsym();	// eat "else"
 				retval = getstatement();
 			}
 		}
 	}
-	else if (sym == s_lcurly) {
+	else if (CTX(sym) == s_lcurly) {
 		getsym(); 	// eat "{"
-		while ((sym != s_eof) && (sym != s_returning) && (sym != s_rcurly)) retval = getstatement();
-		if (sym == s_rcurly) getsym();	// eat "}"
+		while ((CTX(sym) != s_eof) && (CTX(sym) != s_returning) && (CTX(sym) != s_rcurly)) retval = getstatement();
+		if (CTX(sym) == s_rcurly) getsym();	// eat "}"
 	}
-	else if (sym == s_return) {
+	else if (CTX(sym) == s_return) {
 		getsym();	// eat "return"
-		if ((sym != s_eof) && (sym != s_semi)) retval = getnum();
-		sym = s_returning;		// signal we're returning up the line
+		if ((CTX(sym) != s_eof) && (CTX(sym) != s_semi)) retval = getnum();
+		CTX(sym) = s_returning;		// signal we're returning up the line
 	}
 
 #if !defined(TINY_BUILD)
-	else if (sym == s_switch) retval = getswitchstatement();
+	else if (CTX(sym) == s_switch) retval = getswitchstatement();
 #endif
 
-	else if (sym == s_function) cmd_function();
+	else if (CTX(sym) == s_function) cmd_function();
 
-	else if (sym == s_run) {	// run macroname
+	else if (CTX(sym) == s_run) {	// run macroname
 		getsym();
-		if ((sym != s_script_eeprom) && (sym != s_script_progmem) &&
-			(sym != s_script_file)) unexpected(M_id);
+#if defined(TASK_TABLE)
+		// any kind of function will do; note how to run it
+		byte scripttype = SCRIPT_EEPROM;
+		if (CTX(sym) == s_script_progmem) scripttype = SCRIPT_PROGMEM;
+		else if (CTX(sym) == s_script_file) scripttype = SCRIPT_FILE;
+		else if (CTX(sym) == s_nfunct) scripttype = SCRIPT_FUNCTION;
+		else if (CTX(sym) != s_script_eeprom) unexpected(M_id);
+		char scriptname[IDLEN+1];
+		strcpy(scriptname, CTX(idbuf));
+#else
+		if ((CTX(sym) != s_script_eeprom) && (CTX(sym) != s_script_progmem) &&
+			(CTX(sym) != s_script_file)) unexpected(M_id);
+#endif
 
 		// address of macroid is in symval via parseid
 		// check for [,snoozeintervalms]
-		getsym();	// eat macroid to check for comma; symval untouched
-		if (sym == s_comma) {
-			vpush(symval);
+		numvar macroid = CTX(symval);
+		getsym();	// eat macroid to check for comma
+		numvar snoozems = 0;
+#if defined(TASK_TABLE)
+		numvar prio = 0;
+#endif
+		if (CTX(sym) == s_comma) {
 			getsym();			// eat the comma
-			getnum();			// get a number or else
-			startTask(vpop(), expval);
+			snoozems = getnum();			// get a number or else
+#if defined(TASK_TABLE)
+			if (CTX(sym) == s_comma) {			// run foo,ms,priority
+				getsym();
+				prio = getnum();
+			}
+#endif
+		}
+#if defined(TASK_TABLE)
+		taskid slot = startScriptTask(scripttype, macroid, scriptname, snoozems);
+#else
+		taskid slot = startTask(macroid, snoozems);
+#endif
+
+#if defined(TASK_TABLE)
+		if (prio) setTaskPriority(slot, prio);
+
+		// run foo on d3 [change|rising|falling] | on a0 above|below n | on x | on input
+		if (isword("on")) {
+			byte trigger = TRIG_INPUT;
+			byte pin = 0;
+			numvar threshold = 0;
+			getsym();
+			if (CTX(sym) == s_dpin) {
+				pin = CTX(symval);
+				trigger = TRIG_CHANGE;
+				getsym();
+				if (isword("change")) getsym();
+				else if (isword("rising")) { trigger = TRIG_RISING; getsym(); }
+				else if (isword("falling")) { trigger = TRIG_FALLING; getsym(); }
+			}
+			else if (CTX(sym) == s_apin) {
+				pin = CTX(symval);
+				getsym();
+				if (isword("above")) trigger = TRIG_ABOVE;
+				else if (isword("below")) trigger = TRIG_BELOW;
+				else expected(M_op);
+				getsym();
+				threshold = getnum();
+			}
+			else if (CTX(sym) == s_nvar) {
+				pin = CTX(symval);
+				trigger = TRIG_VAR;
+				getsym();
+			}
+			else if (isword("input")) getsym();
+			else unexpected(M_id);
+			setTaskTrigger(slot, trigger, pin, threshold);
+		}
+#endif
+
+#if defined(TASK_TABLE)
+		// run foo,ms fixed [burst|skip|coalesce]
+		if (isword("fixed")) {
+			byte rate = RATE_BURST;
+			getsym();
+			if (isword("burst")) getsym();
+			else if (isword("skip")) { rate = RATE_SKIP; getsym(); }
+			else if (isword("coalesce")) { rate = RATE_COALESCE; getsym(); }
+			setTaskRate(slot, rate);
+		}
+
+		// run foo,ms budget statements[,microseconds]
+		if (isword("budget")) {
+			getsym();
+			numvar steps = getnum();
+			numvar us = 0;
+			if (CTX(sym) == s_comma) {
+				getsym();
+				us = getnum();
+			}
+			setTaskBudget(slot, steps, us);
 		}
-		else startTask(symval, 0);
+#endif
 	}
 
-	else if (sym == s_stop) {
+	else if (CTX(sym) == s_stop) {
 		getsym();
 #if !defined(TINY_BUILD)
-		if (sym == s_mul) {						// stop * stops all tasks
+		if (CTX(sym) == s_mul) {						// stop * stops all tasks
 			initTaskList();
+			saveTasks();
 			getsym();
 		}
-		else if ((sym == s_semi) || (sym == s_eof)) {
-			if (background) stopTask(curtask);	// stop with no args stops the current task IF we're in back
-			else initTaskList();				// in foreground, stop all
+		else if ((CTX(sym) == s_semi) || (CTX(sym) == s_eof)) {
+			if (CTX(background)) stopTask(CTX(curtask));	// stop with no args stops the current task IF we're in back
+			else {								// in foreground, stop all
+				initTaskList();
+				saveTasks();
+			}
 		}
 		else 
 #endif
 			stopTask(getnum());
 	}
 
-	else if (sym == s_rm) {		// rm "sym" or rm *
+	else if (CTX(sym) == s_rm) {		// rm "sym" or rm *
 		getsym();
-		if (sym == s_script_eeprom) {
-			eraseentry(idbuf);
+		if (CTX(sym) == s_script_eeprom) {
+			eraseentry(CTX(idbuf));
 		} 
 #if !defined(TINY_BUILD)
-		else if (sym == s_mul) nukeeeprom();
+		else if (CTX(sym) == s_mul) nukeeeprom();
 #endif
-		else if (sym != s_undef) expected(M_id);
+		else if (CTX(sym) != s_undef) expected(M_id);
 		getsym();
 	}
-	else if (sym == s_ls) 	{ getsym(); cmd_ls(); }
+	else if (CTX(sym) == s_ls) 	{ getsym(); cmd_ls(); }
 #if !defined(TINY_BUILD)
-	else if (sym == s_boot) cmd_boot();
-	else if (sym == s_ps) 	{ getsym();	showTaskList(); }
-	else if (sym == s_peep) { getsym(); cmd_peep(); }
-	else if (sym == s_help) { getsym(); cmd_help(); }
+	else if (CTX(sym) == s_boot) cmd_boot();
+	else if (CTX(sym) == s_ps) {		// ps [firstslot]
+		getsym();
+		if ((CTX(sym) == s_semi) || (CTX(sym) == s_eof)) showTaskList(0);
+		else showTaskList(getnum());
+	}
+	else if (CTX(sym) == s_peep) { getsym(); cmd_peep(); }
+	else if (CTX(sym) == s_help) { getsym(); cmd_help(); }
+#endif
+#if defined(UNIX_BUILD)
+	else if (CTX(sym) == s_prof) {	// prof on|off|dump
+		getsym();
+		if (isword("on")) startProfiler();
+		else if (isword("off")) stopProfiler();
+		else if (isword("dump")) dumpProfile();
+		else unexpected(M_id);
+		getsym();
+	}
 #endif
-	else if (sym == s_print) { getsym(); cmd_print(); }
-	else if (sym == s_semi)	{ ; }	// ;)
+	else if (CTX(sym) == s_print) { getsym(); cmd_print(); }
+	else if (CTX(sym) == s_semi)	{ ; }	// ;)
 
 #ifdef HEX_UPLOAD
 	// a line beginning with a colon is treated as a hex record
@@ -352,7 +470,7 @@ numvar retval = 0;
 	//
 	// TODO: verify checksum
 	//
-	else if (sym == s_colon) {
+	else if (CTX(sym) == s_colon) {
 		// fetchptr points at the byte count
 		byte byteCount = gethex(2);		// 2 bytes byte count
 		int addr = gethex(4);			// 4 bytes address
@@ -361,6 +479,7 @@ numvar retval = 0;
 		if (recordType != 0) return;	// we only handle the data record (00)
 		if (addr == 0) nukeeeprom();	// auto-clear eeprom on write to 0000
 		while (byteCount--) eewrite(addr++, gethex(2));		// update the eeprom
+		newdefinition();
 		gethex(2);						// discard the checksum
 		getsym();						// and re-prime the parser
 	}
@@ -368,10 +487,10 @@ numvar retval = 0;
 
 	else {
 	    getexpression();
-	    retval = expval;
+	    retval = CTX(expval);
 	}
 
-	if (sym == s_semi) getsym();		// eat trailing ';'
+	if (CTX(sym) == s_semi) getsym();		// eat trailing ';'
 	return retval;
 }
 
@@ -381,7 +500,7 @@ numvar retval = 0;
 //
 numvar getstatementlist(void) {
 numvar retval = 0;
-	while ((sym != s_eof) && (sym != s_returning)) retval = getstatement();
+	while ((CTX(sym) != s_eof) && (CTX(sym) != s_returning)) retval = getstatement();
 	return retval;
 }
 
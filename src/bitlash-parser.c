@@ -40,6 +40,8 @@
 #endif
 
 // Interpreter globals
+// On Unix these are per context; see bitlash.h
+#if !defined(BITLASH_CONTEXT)
 byte fetchtype;		// current script type
 numvar fetchptr;	// pointer to current char in script
 numvar symval;		// value of current numeric expression
@@ -55,14 +57,15 @@ numvar expval;				// value of numeric expr or length of string
 
 // Temporary buffer for ids
 char idbuf[IDLEN+1];
+#endif
 
 
 
 const prog_char strings[] PROGMEM = { 
 #if defined(TINY_BUILD)
-	"exp \0unexp \0mssng \0str\0 uflow \0oflow \0\0\0\0exp\0op\0\0eof\0var\0num\0)\0\0eep\0:=\"\0> \0char\0stack\0startup\0id\0prompt\0\r\n\0\0\0"
+	"exp \0unexp \0mssng \0str\0 uflow \0oflow \0\0\0\0exp\0op\0\0eof\0var\0num\0)\0\0eep\0:=\"\0> \0char\0stack\0startup\0id\0prompt\0\r\n\0\0\0\0"
 #else
-	"expected \0unexpected \0missing \0string\0 underflow\0 overflow\0^C\0^B\0^U\0exp\0op\0:xby+-*/\0eof\0var\0number\0)\0saved\0eeprom\0:=\"\0> \0char\0stack\0startup\0id\0prompt\0\r\nFunctions:\0oops\0arg\0function\0"
+	"expected \0unexpected \0missing \0string\0 underflow\0 overflow\0^C\0^B\0^U\0exp\0op\0:xby+-*/\0eof\0var\0number\0)\0saved\0eeprom\0:=\"\0> \0char\0stack\0startup\0id\0prompt\0\r\nFunctions:\0oops\0arg\0function\0duplicate\0"
 #endif
 };
 
@@ -138,14 +141,14 @@ byte isalnum(byte c) { return isalpha(c) || isdigit(c); }
 byte tolower(byte c) {
 	return ((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c;
 }
-byte is_end(void) { return ((sym == s_eof) || (sym == s_semi)); }
+byte is_end(void) { return ((CTX(sym) == s_eof) || (CTX(sym) == s_semi)); }
 #endif
 
 // Tests on the symbol type
 byte isrelop(void) {
-	return ((sym == s_lt) || (sym == s_le)
-			|| (sym == s_logicaleq) || (sym == s_logicalne)
-			|| (sym == s_gt) || (sym == s_ge));
+	return ((CTX(sym) == s_lt) || (CTX(sym) == s_le)
+			|| (CTX(sym) == s_logicaleq) || (CTX(sym) == s_logicalne)
+			|| (CTX(sym) == s_gt) || (CTX(sym) == s_ge));
 }
 byte ishex(char c) { 
 	return ((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'f')) || ((c >= 'A') && (c <= 'F')); 
@@ -163,13 +166,14 @@ byte trace;
 
 //	Parse the next token from the input stream.
 void getsym(void) {
+	countstat(tokens[CTX(fetchtype)]);
 
 	// dispatch to handler for this type of char
-	(*tokenhandlers[chartype(inchar)])();
+	(*tokenhandlers[chartype(CTX(inchar))])();
 
 #ifdef PARSER_TRACE
 	if (trace) {
-		sp(" sym="); printInteger(sym, 0, ' '); sp(" v="); printInteger(symval, 0, ' '); spb(' ');
+		sp(" sym="); printInteger(CTX(sym), 0, ' '); sp(" v="); printInteger(CTX(symval), 0, ' '); spb(' ');
 	}
 #endif
 }
@@ -178,9 +182,9 @@ void getsym(void) {
 #ifdef PARSER_TRACE
 void tb(void) {		// print a mini-trace
 	if (!trace) return;
-	sp("@");printHex((unsigned long)fetchptr); spb(' ');
-	sp("s");printHex(sym); spb(' ');
-	sp("i");printHex(inchar); speol();
+	sp("@");printHex((unsigned long)CTX(fetchptr)); spb(' ');
+	sp("s");printHex(CTX(sym)); spb(' ');
+	sp("i");printHex(CTX(inchar)); speol();
 }
 #endif
 
@@ -190,17 +194,213 @@ void tb(void) {		// print a mini-trace
 ///
 ///		Expression evaluation stack
 ///
+#if !defined(BITLASH_CONTEXT)
+numvar *arg;				// argument frame pointer
+#endif
+
+#if defined(SEGMENTED_STACK)
+////////////////////
+///
+///	Segmented value stack
+///
+///		The stack is a chain of chunks.  Pushing past the bottom of a chunk
+///		continues in a new one, and popping the last value from a chunk returns 
+///		to the previous one, so the hot path is a pointer bump and a compare.
+///
+///		An argblock must not straddle chunks, since its args are addressed as 
+///		arg[-n].  parsearglist() calls vreserve() to start a new chunk if the 
+///		largest possible argblock won't fit in the current one.
+///
+///		One spare chunk is kept to avoid malloc/free churn at a boundary.
+///
+#define VMAXCHUNKS 64			// 64 * 256 values; runaway recursion stops here
+
+#if !defined(BITLASH_CONTEXT)
+vchunk vstackbase;				// the first chunk is static
+vchunk *vchunkp;				// current chunk
+vchunk *vspare;					// a free chunk, or NULL
+byte vchunks;					// chunks in the chain
+numvar *vsp;					// value stack pointer: next free slot
+numvar *vsbottom;				// lowest slot in the current chunk
+#endif
+
+#define vstop (&CTX(vchunkp)->slots[VCHUNKLEN-1])
+#define vstacktop() CTX(vsp)
+
+void vnewchunk(void) {
+	vchunk *c = CTX(vspare);
+	if (c) CTX(vspare) = 0;
+	else {
+		if (CTX(vchunks) >= VMAXCHUNKS) overflow(M_exp);
+		c = (vchunk *) malloc(sizeof(vchunk));
+		if (!c) overflow(M_exp);
+	}
+	c->prev = CTX(vchunkp);
+	c->savedsp = CTX(vsp);
+	CTX(vchunkp) = c;
+	CTX(vchunks)++;
+	CTX(vsbottom) = &c->slots[0];
+	CTX(vsp) = &c->slots[VCHUNKLEN-1];
+}
+
+void vdropchunk(void) {
+	vchunk *c = CTX(vchunkp);
+	CTX(vchunkp) = c->prev;
+	CTX(vsp) = c->savedsp;
+	CTX(vsbottom) = &CTX(vchunkp)->slots[0];
+	CTX(vchunks)--;
+	if (CTX(vspare)) free(c);
+	else CTX(vspare) = c;
+}
+
+// make sure n values can be pushed without changing chunks
+void vreserve(int n) {
+	if (CTX(vsp) - CTX(vsbottom) + 1 < n) vnewchunk();
+}
+
+// pop n values at once
+void vpopn(int n) {
+	CTX(vsp) += n;
+	if ((CTX(vsp) >= vstop) && CTX(vchunkp)->prev) vdropchunk();
+}
+
+void vpush(numvar x) {
+	if (CTX(vsp) < CTX(vsbottom)) vnewchunk();
+	*CTX(vsp)-- = x;
+}
+
+numvar vpop(void) {
+	if (CTX(vsp) >= vstop) underflow(M_exp);		// only the first chunk is ever empty
+	numvar x = *++CTX(vsp);
+	if ((CTX(vsp) >= vstop) && CTX(vchunkp)->prev) vdropchunk();
+	return x;
+}
+
+
+////////////////////
+///
+///	String Pool
+///
+///		The string pool is a bump allocator in a chain of chunks of its own.
+///		It holds string constants parsed from arg blocks.
+///		The pointers themselves are passed as arg(n) values.
+///		The whole string pool for an argblock is deallocated
+///		when the argblock is released.
+///
+///		A string must not straddle chunks, so poolreserve() is called before
+///		each one to make sure STRVALSIZE bytes are available.
+///
+#define POOLMAXCHUNKS 64
+
+#if !defined(BITLASH_CONTEXT)
+poolchunk poolbase;
+poolchunk *poolchunkp;
+poolchunk *poolspare;
+byte poolchunks;
+char *stringPool;
+#endif
+
+// push a character into the string pool
+void spush(char c) {
+	if (CTX(stringPool) >= CTX(poolchunkp)->limit) overflow(M_string);
+	*CTX(stringPool)++ = c;
+}
+
+void poolreserve(void) {
+	if (CTX(poolchunkp)->limit - CTX(stringPool) >= STRVALSIZE) return;
+	poolchunk *c = CTX(poolspare);
+	if (c) CTX(poolspare) = 0;
+	else {
+		if (CTX(poolchunks) >= POOLMAXCHUNKS) overflow(M_string);
+		c = (poolchunk *) malloc(sizeof(poolchunk));
+		if (!c) overflow(M_string);
+	}
+	c->prev = CTX(poolchunkp);
+	c->limit = c->bytes + POOLCHUNKLEN;
+	CTX(poolchunkp) = c;
+	CTX(poolchunks)++;
+	CTX(stringPool) = c->bytes;
+}
+
+// return the chunk holding p, or NULL if p is not in the pool
+poolchunk *findpoolchunk(char *p) {
+	poolchunk *c = CTX(poolchunkp);
+	while (c) {
+		if ((p >= c->bytes) && (p < c->limit)) return c;
+		c = c->prev;
+	}
+	return 0;
+}
+#define inpool(p) (findpoolchunk((char *) (p)) != 0)
+
+// release the pool back to p, which must be in the pool
+void poolrelease(char *p) {
+	poolchunk *c = findpoolchunk(p);
+	while (CTX(poolchunkp) != c) {
+		poolchunk *drop = CTX(poolchunkp);
+		CTX(poolchunkp) = drop->prev;
+		CTX(poolchunks)--;
+		if (CTX(poolspare)) free(drop);
+		else CTX(poolspare) = drop;
+	}
+	CTX(stringPool) = p;
+}
+
+
+void vinit(void) {
+	CTX(arg) = 0;				// no frames to walk while the chunks are freed
+	while (CTX(vchunkp) && CTX(vchunkp)->prev) vdropchunk();
+	CTX(vchunkp) = &CTX(vstackbase);
+	CTX(vchunks) = 1;
+	CTX(vsbottom) = &CTX(vstackbase).slots[0];
+	CTX(vsp) = &CTX(vstackbase).slots[VCHUNKLEN-1];
+	vpush(0);				// the top frame has no parent
+	CTX(arg) = CTX(vsp);				// point the argblock at the stack base
+	vpush(0);				// push a 0 there so arg(0) is 0 at the top
+
+	if (!CTX(poolchunkp)) {
+		CTX(poolbase).limit = CTX(poolbase).bytes + POOLCHUNKLEN;
+		CTX(poolchunkp) = &CTX(poolbase);
+		CTX(poolchunks) = 1;
+	}
+	poolrelease(CTX(poolbase).bytes);
+	*CTX(stringPool) = 0;				// make it look empty
+}
+
+#ifdef BITLASH_CONTEXT
+// give back everything the current context took from the heap
+void vfree(void) {
+	vinit();
+	free(CTX(vspare));
+	CTX(vspare) = 0;
+	free(CTX(poolspare));
+	CTX(poolspare) = 0;
+	int i;
+	for (i=0; i < NAMEHASHLEN; i++) {
+		while (CTX(namehash)[i]) {
+			namenode *n = CTX(namehash)[i];
+			CTX(namehash)[i] = n->next;
+			free(n);
+		}
+	}
+}
+#endif
+
+#else	// fixed value stack and string pool
+
 #if defined(MEGA) || defined(UNIX_BUILD) || defined(ARM_BUILD)
 #define VSTACKLEN 256
 #else
 #define VSTACKLEN 64
 #endif
 byte vsptr;			  		// value stack pointer
-numvar *arg;				// argument frame pointer
 numvar vstack[VSTACKLEN];  	// value stack
 
+#define vstacktop() (&vstack[vsptr])
+#define vreserve(n)
+#define vpopn(n) (vsptr += (n))
+
 
-#define STRING_POOL
 ////////////////////
 ///
 ///	String Pool
@@ -217,33 +417,33 @@ char *stringPool;
 
 // push a character into the string pool
 void spush(char c) {
-	if (stringPool >= (char *) &vstack[vsptr]) overflow(M_string);
-	*stringPool++ = c;
+	if (CTX(stringPool) >= (char *) &vstack[vsptr]) overflow(M_string);
+	*CTX(stringPool)++ = c;
 }
 
-// push a string into the string pool
-void strpush(char *ptr) {
-	while (*ptr) spush(*ptr++);
-	spush(0);
-}
+#define poolreserve()
+#define inpool(p) (((char *) (p) >= (char *) vstack) && ((char *) (p) < (char *) &vstack[VSTACKLEN]))
+#define poolrelease(p) (CTX(stringPool) = (p))
 
 #endif	// STRING_POOL
 
 
 void vinit(void) {
-	vsptr = VSTACKLEN-3;	// reserve two slots for callername and calleename
-	arg = &vstack[vsptr];	// point the argblock at the stack base
+	vsptr = VSTACKLEN-2;	// reserve a slot for the top frame's parent pointer
+	CTX(arg) = &vstack[vsptr];	// point the argblock at the stack base
+	vstack[VSTACKLEN-1] = 0;	// the top frame has no parent
 	vpush(0);				// push a 0 there so arg(0) is 0 at the top
 #if defined(STRING_POOL)
-	stringPool = (char *) vstack;	// stringPool starts at unused base of vstack
-	*stringPool = 0;				// make it look empty
+	CTX(stringPool) = (char *) vstack;	// stringPool starts at unused base of vstack
+	*CTX(stringPool) = 0;				// make it look empty
 #endif
 }
 
 void vpush(numvar x) {
 
 #if defined(STRING_POOL)
-	if ((char *) &vstack[vsptr] < stringPool) overflow(M_exp);
+	// vsptr is a byte: stop at the bottom rather than wrap around
+	if (!vsptr || ((char *) &vstack[vsptr] < CTX(stringPool))) overflow(M_exp);
 #else
 	if (vsptr <= 0) overflow(M_exp);
 #endif
@@ -255,6 +455,18 @@ numvar vpop(void) {
 	return vstack[++vsptr];
 }
 
+#endif	// SEGMENTED_STACK
+
+
+#if defined(STRING_POOL)
+// push a string into the string pool
+void strpush(char *ptr) {
+	while (*ptr) spush(*ptr++);
+	spush(0);
+}
+#endif
+
+
 void vop(byte op)  {
 numvar x,y;
 	x = vpop(); y = vpop();
@@ -288,14 +500,26 @@ numvar x,y;
 /// Argument Block handling
 ///
 
+//	An argblock looks like this on the value stack, which grows down:
+//
+//		arg[2]		name of the called script function (ARG_NAMED frames only)
+//		arg[1]		parent argblock
+//		arg[0]		arg count | ARG_NAMED | string arg bits << ARGTYPE_SHIFT
+//		arg[-1]		first argument
+//		...
+//		arg[-n]		last argument
+//
+//	Built-in and user C functions get unnamed frames: two words plus the args.
+//
 numvar getarg(numvar which) {
-	if (which > arg[0]) missing(M_arg);
-	return arg[-which];
+	if (which > argcount(CTX(arg))) missing(M_arg);
+	if (!which) return argcount(CTX(arg));
+	return CTX(arg)[-which];
 }
 
 #if defined(STRING_POOL)
 numvar isstringarg(numvar which) {		// isstringarg() api for C user functions
-	return ((arg[2] & (1<<(which-1))) != 0);
+	return ((CTX(arg)[0] & ((numvar) 1 << (ARGTYPE_SHIFT + which - 1))) != 0);
 }
 
 //	Bitlash test function for isstr():
@@ -304,8 +528,8 @@ numvar isstringarg(numvar which) {		// isstringarg() api for C user functions
 numvar isstring(void) {					// isstr() for Bitlash functions
 	// we are interested in the type of args in our
 	// parent's stack frame, the caller of isstr()
-	numvar *parentarg = (numvar *) arg[3];
-	return ((parentarg[2] & (1<<(getarg(1)-1))) != 0);
+	numvar *parentarg = argparent(CTX(arg));
+	return ((parentarg[0] & ((numvar) 1 << (ARGTYPE_SHIFT + getarg(1) - 1))) != 0);
 }
 
 numvar getstringarg(numvar which) {
@@ -315,57 +539,197 @@ numvar getstringarg(numvar which) {
 #endif
 
 
-void parsearglist(void) {
-	vpush((numvar) arg);				// save base of current argblock
 #if defined(STRING_POOL)
-	vpush(0);							// argtype: argument type vector, initially 0
-	vpush((numvar) stringPool);			// save stringPool base for later release
-	strpush(idbuf);						// save called function's name as arg[-1]
+
+#ifdef CALL_CACHE
+////////////////////
+///
+///	Literal cache
+///
+///		String literals in EEPROM and PROGMEM scripts are copied once into
+///		the literal pool and passed by reference from there, instead of being 
+///		parsed into the string pool on every call.  printf("%d\n",x) in a loop
+///		costs one lookup per iteration, and the parser jumps straight past the
+///		literal in the script text.
+///
+///		Entries are validated against defgeneration like the call site cache.
+///		The pool is reclaimed by reclaimliterals() at the top of a command, when
+///		no argblock can still point into it.
+///
+#if !defined(BITLASH_CONTEXT)
+litcache_entry litcache[LITCACHELEN];
+char litpool[LITPOOLSIZE];
+int litpoolused;
+unsigned long litgeneration;
+#endif
+
+#define litcacheslot(type, site) (&CTX(litcache)[((site) ^ ((site) >> 5) ^ (type)) & (LITCACHELEN-1)])
+
+void reclaimliterals(void) {
+	if (CTX(litgeneration) == defgeneration) return;		// nothing has been redefined
+	memset(CTX(litcache), 0, sizeof(CTX(litcache)));
+	CTX(litpoolused) = 0;
+	CTX(litgeneration) = defgeneration;
+}
 #endif
-	numvar *newarg = &vstack[vsptr];	// move global arg pointer to base of new block
-	vpush(0);							// initialize new arg(0) (a/k/a argc) to 0
 
-	if (sym == s_lparen) {
+
+// Parse a "quoted string" argument and return a pointer to the parsed string
+//
+// Enter with sym = s_quote therefore inchar = first char in string
+// Exit with inchar = first char past closing s_quote
+//
+numvar getstringliteral(void) {
+#ifdef CALL_CACHE
+	numvar site = CTX(fetchptr);
+	byte type = CTX(fetchtype);
+	litcache_entry *e = litcacheslot(type, site);
+	if ((e->generation == defgeneration) && (e->site == site) && (e->type == type)) {
+		CTX(fetchptr) = e->end;		// skip the literal text
+		primec();
+		return (numvar) e->str;
+	}
+#endif
+
+	poolreserve();
+	char *str = CTX(stringPool);
+	parsestring(&spush);		// parse it into the pool
+	spush(0);					// and terminate it
+
+#ifdef CALL_CACHE
+	// move it to the literal pool if it came from a script that holds still
+	if (((type == SCRIPT_EEPROM) || (type == SCRIPT_PROGMEM)) && (CTX(litgeneration) == defgeneration)) {
+		int len = CTX(stringPool) - str;
+		if (CTX(litpoolused) + len <= LITPOOLSIZE) {
+			e->site = site;
+			e->end = CTX(fetchptr);
+			e->str = CTX(litpool) + CTX(litpoolused);
+			e->type = type;
+			e->generation = defgeneration;
+			memcpy(e->str, str, len);
+			CTX(litpoolused) += len;
+			CTX(stringPool) = str;	// give back the string pool space
+			return (numvar) e->str;
+		}
+	}
+#endif
+	return (numvar) str;
+}
+#endif	// STRING_POOL
+
+
+#if !defined(AVR_BUILD)
+////////////////////
+///
+///	Name interning
+///
+///		Named frames point at a single shared copy of the function's name
+///		instead of copying it into the string pool on every call.
+///		Names are never freed; there is one per distinct script function called.
+///
+#if !defined(BITLASH_CONTEXT)
+namenode *namehash[NAMEHASHLEN];
+#endif
+
+char *internname(char *name) {
+	unsigned int h = 0;
+	char *p = name;
+	while (*p) h = (h * 31) + (byte) *p++;
+	namenode **bucket = &CTX(namehash)[h & (NAMEHASHLEN-1)];
+	namenode *n = *bucket;
+	while (n) {
+		if (!strcmp(n->name, name)) return n->name;
+		n = n->next;
+	}
+	n = (namenode *) malloc(sizeof(namenode));
+	if (!n) overflow(M_id);
+	strncpy(n->name, name, IDLEN);
+	n->name[IDLEN] = 0;
+	n->next = *bucket;
+	*bucket = n;
+	return n->name;
+}
+#endif
+
+
+//	Parse an argument list and activate a new argblock for it
+//
+//	named: true for script function calls, which need the name in idbuf
+//	to find their script text and for traceback
+//
+void parsearglist(byte named) {
+	vreserve(ARGC_MASK + 3);			// the whole argblock must fit in one stack chunk
+	if (named) {
+#if defined(AVR_BUILD)
+		char *name = CTX(stringPool);
+		strpush(CTX(idbuf));					// the name opens this frame's string pool slab
+		vpush((numvar) name);
+#else
+		vpush((numvar) internname(CTX(idbuf)));
+#endif
+	}
+	vpush((numvar) CTX(arg));				// save base of current argblock
+	numvar *newarg = vstacktop();		// move global arg pointer to base of new block
+	vpush(named ? ARG_NAMED : 0);		// initialize new arg(0) (a/k/a argc) to 0
+
+	if (CTX(sym) == s_lparen) {
 		getsym();		// eat arglist '('
-		while ((sym != s_rparen) && (sym != s_eof)) {
+		while ((CTX(sym) != s_rparen) && (CTX(sym) != s_eof)) {
+			byte argc = newarg[0] & ARGC_MASK;
+			if (argc >= ARGC_MASK) overflow(M_arg);
 
 #if defined(STRING_POOL)
-			if (sym == s_quote) {
-				vpush((numvar) stringPool);	// push the string pointer
-				parsestring(&spush);		// parse it into the pool
-				spush(0);					// and terminate it
+			if (CTX(sym) == s_quote) {
+				vpush(getstringliteral());	// push the string pointer
 				getsym();					// eat closing "
 
-				// bug: more than 32 args fails here
-				newarg[2] |= (1 << newarg[0]);	// argtype: set string bit for this arg
+				// string args past the width of the type bits are not marked
+				if (ARGTYPE_SHIFT + argc < (sizeof(numvar) * 8) - 1)
+					newarg[0] |= (numvar) 1 << (ARGTYPE_SHIFT + argc);	// argtype: set string bit for this arg
 			} else 
 #endif
 			vpush(getnum());				// push the value
 			newarg[0]++;					// bump the count
-			if (sym == s_comma) getsym();	// eat arglist ',' and go around
+			if (CTX(sym) == s_comma) getsym();	// eat arglist ',' and go around
 			else break;
 		}
-		if (sym == s_rparen) getsym();		// eat the ')'
+		if (CTX(sym) == s_rparen) getsym();		// eat the ')'
 		else expected(M_rparen);
 	}
-	arg = newarg;		// activate new argument frame
+	CTX(arg) = newarg;		// activate new argument frame
 }
 
 
 // release the top argblock once its execution context has expired
 //
 void releaseargblock(void) {
-	vsptr += arg[0] + 1;				// pop all args en masse, and the count
+	numvar argword = CTX(arg)[0];
+	byte named = (argword & ARG_NAMED) != 0;
 
 #if defined(STRING_POOL)
-	// deallocate the string pool slab used by this function
-	// by popping the saved caller's stringPool
-	stringPool = (char *) vpop();
-
-	vpop();		// argtype: pop argument type storage
+	// deallocate the string pool slab used by this function.
+	// the slab starts at the first of our strings that was put in the pool:
+	// the name (on AVR), else the first pooled string argument
+	if (named && inpool(CTX(arg)[2])) poolrelease((char *) CTX(arg)[2]);
+	else {
+		byte which = 1;
+		numvar types = argword >> ARGTYPE_SHIFT;
+		while (types) {
+			if ((types & 1) && inpool(CTX(arg)[-which])) {
+				poolrelease((char *) CTX(arg)[-which]);
+				break;
+			}
+			types >>= 1;
+			which++;
+		}
+	}
 #endif
 
-	arg = (numvar *) vpop();			// pop parent arg frame and we're back
+	// pop all args en masse, the count, the parent, and the name if any
+	// back to the parent arg frame first: the pop may free the chunk this
+	// one is in, and the profiler may walk the frames at any moment
+	CTX(arg) = argparent(CTX(arg));
+	vpopn((argword & ARGC_MASK) + 2 + named);
 }
 
 
@@ -377,6 +741,9 @@ void releaseargblock(void) {
 #if defined(TINY_BUILD)
 const prog_char reservedwords[] PROGMEM = { "boot\0if\0run\0stop\0switch\0while\0" };
 const prog_uchar reservedwordtypes[] PROGMEM = { s_boot, s_if, s_run, s_stop, s_switch, s_while };
+#elif defined(UNIX_BUILD)
+const prog_char reservedwords[] PROGMEM = { "arg\0boot\0else\0function\0help\0if\0ls\0peep\0print\0prof\0ps\0return\0rm\0run\0stop\0switch\0while\0" };
+const prog_uchar reservedwordtypes[] PROGMEM = { s_arg, s_boot, s_else, s_function, s_help, s_if, s_ls, s_peep, s_print, s_prof, s_ps, s_return, s_rm, s_run, s_stop, s_switch, s_while };
 #else
 const prog_char reservedwords[] PROGMEM = { "arg\0boot\0else\0function\0help\0if\0ls\0peep\0print\0ps\0return\0rm\0run\0stop\0switch\0while\0" };
 const prog_uchar reservedwordtypes[] PROGMEM = { s_arg, s_boot, s_else, s_function, s_help, s_if, s_ls, s_peep, s_print, s_ps, s_return, s_rm, s_run, s_stop, s_switch, s_while };
@@ -384,13 +751,13 @@ const prog_uchar reservedwordtypes[] PROGMEM = { s_arg, s_boot, s_else, s_functi
 
 // find id in PROGMEM wordlist.  result in symval, return true if found.
 byte findindex(char *id, const prog_char *wordlist, byte sorted) {
-	symval = 0;
+	CTX(symval) = 0;
 	while (pgm_read_byte(wordlist)) {
 		int result = strcmp_P(id, wordlist);
 		if (!result) return 1;
 		else if (sorted && (result < 0)) break;	// only works if list is sorted!
 		else {
-			symval++;
+			CTX(symval)++;
 			wordlist += strlen_P(wordlist) + 1;
 		}
 	}
@@ -438,10 +805,10 @@ const prog_uchar pinvalues[] PROGMEM = {
 
 byte findpinname(char *alias) {
 	if (!findindex(alias, (const prog_char *) pinnames, 0)) return 0;		// sets symval
-	byte pin = pgm_read_byte(pinvalues + symval);
+	byte pin = pgm_read_byte(pinvalues + CTX(symval));
 	//sym = (pin & PV_ANALOG) ? s_apin : s_dpin;
-	sym = (pin & PV_ANALOG) ? s_apin : ((pin & PV_VAR) ? s_nvar : s_dpin);
-	symval = pin & PV_MASK;
+	CTX(sym) = (pin & PV_ANALOG) ? s_apin : ((pin & PV_VAR) ? s_nvar : s_dpin);
+	CTX(symval) = pin & PV_MASK;
 	return 1;
 }
 #endif
@@ -452,25 +819,33 @@ byte findpinname(char *alias) {
 #define NUMVARS 26
 #endif
 numvar vars[NUMVARS];		// 'a' through 'z'
+#ifdef TASK_WORKERS
+// tasks on other threads share the variables, so x++ must not lose updates
+void assignVar(byte id, numvar value) { __atomic_store_n(&vars[id], value, __ATOMIC_RELAXED); }
+numvar getVar(byte id) { return __atomic_load_n(&vars[id], __ATOMIC_RELAXED); }
+numvar addVar(byte id, numvar n) { return __atomic_add_fetch(&vars[id], n, __ATOMIC_RELAXED); }
+#else
 void assignVar(byte id, numvar value) { vars[id] = value; }
 numvar getVar(byte id) { return vars[id]; }
-numvar incVar(byte id) { return ++vars[id]; }
+numvar addVar(byte id, numvar n) { return vars[id] += n; }
+#endif
+numvar incVar(byte id) { return addVar(id, 1); }
 
 
 // Token handlers to parse the various token types
 
 // Skip to next nonblank and return the symbol therefrom
 void skpwhite(void) {
-	while (chartype(inchar) == 0) fetchc();
+	while (chartype(CTX(inchar)) == 0) fetchc();
 	getsym();
 }
 
 // Comment: Skip from // to end of line, return next symbol
 void skipcomment(void) {
-	while (sym == s_comment) {
-		while (inchar && (inchar != '\n') && (inchar != '\r')) fetchc();
-		if (!inchar) {
-			sym = s_eof;
+	while (CTX(sym) == s_comment) {
+		while (CTX(inchar) && (CTX(inchar) != '\n') && (CTX(inchar) != '\r')) fetchc();
+		if (!CTX(inchar)) {
+			CTX(sym) = s_eof;
 			return;
 		}
 		else {
@@ -484,17 +859,17 @@ void skipcomment(void) {
 void badsym(void) {
 	unexpected(M_char);
 #if !defined(TINY_BUILD)
-	printHex(inchar);speol();
+	printHex(CTX(inchar));speol();
 #endif
 }
 
 // Parse a character constant of the form 'c'
 void chrconst(void) {
 	fetchc();
-	symval = inchar;
-	sym = s_nval;
+	CTX(symval) = CTX(inchar);
+	CTX(sym) = s_nval;
 	fetchc();
-	if (inchar != '\'') expectedchar('\'');
+	if (CTX(inchar) != '\'') expectedchar('\'');
 	fetchc();		// consume "
 }
 
@@ -507,7 +882,7 @@ const prog_uchar twocharsyms[] PROGMEM = {
 
 // Parse a one- or two-char operator like >, >=, >>, ...	
 void parseop(void) {
-	sym = inchar;		// think horse not zebra
+	CTX(sym) = CTX(inchar);		// think horse not zebra
 	fetchc();			// inchar has second char of token or ??
 
 	const prog_char *tk = twochartokens;
@@ -517,10 +892,10 @@ void parseop(void) {
 		if (!c1) return;
 		byte c2 = pgm_read_byte(tk++); 
 
-		if ((sym == c1) && (inchar == c2)) {
-			sym = (byte) pgm_read_byte(twocharsyms + index);
+		if ((CTX(sym) == c1) && (CTX(inchar) == c2)) {
+			CTX(sym) = (byte) pgm_read_byte(twocharsyms + index);
 			fetchc();
-			if (sym == s_comment) skipcomment();
+			if (CTX(sym) == s_comment) skipcomment();
 			return;
 		}
 		index++;
@@ -529,92 +904,164 @@ void parseop(void) {
 
 //	One-char literal symbols, like '*' and '+'.
 void litsym(void) {
-	sym = inchar;
+	CTX(sym) = CTX(inchar);
 	fetchc();
 }
 
 // End of input
 void eof(void) {
-	sym = s_eof;
+	CTX(sym) = s_eof;
 }
 
 // Parse a numeric constant from the input stream
 void parsenum(void) {
 byte radix;
 	radix = 10;
-	symval = inchar - '0';
+	CTX(symval) = CTX(inchar) - '0';
 	for (;;) {
 		fetchc();
-		inchar = tolower(inchar);
-		if ((radix == 10) && (symval == 0)) {
-			if (inchar == 'x') { radix = 16; continue; }
-			else if (inchar == 'b') { radix = 2; continue; }
+		CTX(inchar) = tolower(CTX(inchar));
+		if ((radix == 10) && (CTX(symval) == 0)) {
+			if (CTX(inchar) == 'x') { radix = 16; continue; }
+			else if (CTX(inchar) == 'b') { radix = 2; continue; }
 		}
-		if (isdigit(inchar)) {
-			inchar = inchar - '0';
-			if (inchar >= radix) break;
-			symval = (symval*radix) + inchar;
+		if (isdigit(CTX(inchar))) {
+			CTX(inchar) = CTX(inchar) - '0';
+			if (CTX(inchar) >= radix) break;
+			CTX(symval) = (CTX(symval)*radix) + CTX(inchar);
 		}
 		else if (radix == 16) {
-			if ((inchar >= 'a') && (inchar <= 'f'))
-				symval = (symval*radix) + inchar - 'a' + 10;
+			if ((CTX(inchar) >= 'a') && (CTX(inchar) <= 'f'))
+				CTX(symval) = (CTX(symval)*radix) + CTX(inchar) - 'a' + 10;
 			else break;
 		}
 		else break;
 	}
-	sym = s_nval;
+	CTX(sym) = s_nval;
+}
+
+
+#ifdef CALL_CACHE
+//////////
+//
+//	Call site cache
+//
+//	Resolving an identifier means scanning the reserved words, the function
+//	dictionary, the user function table, the EEPROM and the file system, and
+//	a loop in a script does it again for every identifier each time around.
+//
+//	The cache remembers what the identifier at a given place in an EEPROM or 
+//	PROGMEM script resolved to.  Entries are stamped with defgeneration, which 
+//	is bumped via newdefinition() whenever a definition may have changed, 
+//	so stale entries are simply ignored.
+//
+//	RAM scripts are not cached because the command buffer is reused, 
+//	and file scripts are not cached because their offsets are not unique.
+//
+#if !defined(BITLASH_CONTEXT)
+callcache_entry callcache[CALLCACHELEN];
+#endif
+#if defined(UNIX_BUILD)
+_Atomic unsigned long defgeneration = 1;
+#else
+unsigned long defgeneration = 1;
+#endif
+
+#define callcacheslot(type, site) (&CTX(callcache)[((site) ^ ((site) >> 6) ^ (type)) & (CALLCACHELEN-1)])
+
+// look up the call site; on a hit, set sym and symval and return true
+byte findcallsite(byte type, numvar site) {
+	callcache_entry *e = callcacheslot(type, site);
+	if ((e->generation != defgeneration) || (e->site != site) || (e->type != type)) return 0;
+	CTX(sym) = e->token;
+	CTX(symval) = e->value;
+	return 1;
 }
 
+// remember how the identifier at this call site resolved
+void cachecallsite(byte type, numvar site) {
+	if ((type != SCRIPT_EEPROM) && (type != SCRIPT_PROGMEM)) return;
+	if (CTX(sym) == s_undef) return;		// it may be defined later; look again next time
+	callcache_entry *e = callcacheslot(type, site);
+	e->site = site;
+	e->type = type;
+	e->token = CTX(sym);
+	e->value = CTX(symval);
+	e->generation = defgeneration;
+}
+#endif
+
 
 // Parse an identifier from the input stream
 void parseid(void) {
-	char c = *idbuf = tolower(inchar);
+#ifdef CALL_CACHE
+	numvar site = CTX(fetchptr);		// call site cache key: where the identifier starts
+	byte sitetype = CTX(fetchtype);
+#endif
+	char c = *CTX(idbuf) = tolower(CTX(inchar));
 	byte idbuflen = 1;
 	fetchc();
-	while (isalnum(inchar) || (inchar == '.') || (inchar == '_')) {
+	while (isalnum(CTX(inchar)) || (CTX(inchar) == '.') || (CTX(inchar) == '_')) {
 		if (idbuflen >= IDLEN) overflow(M_id);
-		idbuf[idbuflen++] = tolower(inchar);
+		CTX(idbuf)[idbuflen++] = tolower(CTX(inchar));
 		fetchc();
 	}
-	idbuf[idbuflen] = 0;
+	CTX(idbuf)[idbuflen] = 0;
 
 	// do we have a one-char alpha nvar identifier?
 	if ((idbuflen == 1) && isalpha(c)) {
-		sym = s_nvar;
-		symval = c - 'a';
+		CTX(sym) = s_nvar;
+		CTX(symval) = c - 'a';
 	}
 	
 	// a pin identifier 'a'digit* or 'd'digit*?
 	else if ((idbuflen <= 3) &&
 		((c == 'a') || (c == 'd')) && 
-		isdigit(idbuf[1]) && (
+		isdigit(CTX(idbuf)[1]) && (
 #if !defined(TINY_BUILD)
-		isdigit(idbuf[2]) || 
+		isdigit(CTX(idbuf)[2]) || 
 #endif
-		(idbuf[2] == 0))) {
-		sym = (c == 'a') ? s_apin : s_dpin;
-		symval = pinnum(idbuf);
+		(CTX(idbuf)[2] == 0))) {
+		CTX(sym) = (c == 'a') ? s_apin : s_dpin;
+		CTX(symval) = pinnum(CTX(idbuf));
+	}
+
+#ifdef CALL_CACHE
+	// seen here before?  sym and symval are set in findcallsite
+	else if (findcallsite(sitetype, site)) {;}
+
+	else {
+		resolveid();
+		cachecallsite(sitetype, site);
 	}
+#else
+	else resolveid();
+#endif
+}
+
+
+// Look up the identifier in idbuf; set sym and symval accordingly
+void resolveid(void) {
 
 	// reserved word?
-	else if (findindex(idbuf, (const prog_char *) reservedwords, 1)) {
-		sym = pgm_read_byte(reservedwordtypes + symval);	// e.g., s_if or s_while
+	if (findindex(CTX(idbuf), (const prog_char *) reservedwords, 1)) {
+		CTX(sym) = pgm_read_byte(reservedwordtypes + CTX(symval));	// e.g., s_if or s_while
 	}
 
 	// function?
-	else if (findindex(idbuf, (const prog_char *) functiondict, 1)) sym = s_nfunct;
+	else if (findindex(CTX(idbuf), (const prog_char *) functiondict, 1)) CTX(sym) = s_nfunct;
 
 #ifdef LONG_ALIASES
-	else if (findindex(idbuf, (const prog_char *) aliasdict, 0)) sym = s_nfunct;
+	else if (findindex(CTX(idbuf), (const prog_char *) aliasdict, 0)) CTX(sym) = s_nfunct;
 #endif
 
 #ifdef PIN_ALIASES
-	else if (findpinname(idbuf)) {;}		// sym and symval are set in findpinname
+	else if (findpinname(CTX(idbuf))) {;}		// sym and symval are set in findpinname
 #endif
 
-	else if (find_user_function(idbuf)) sym = s_nfunct;
+	else if (find_user_function(CTX(idbuf))) CTX(sym) = s_nfunct;
 
-	else findscript(idbuf);
+	else findscript(CTX(idbuf));
 }
 
 
@@ -622,24 +1069,24 @@ void parseid(void) {
 //
 //	findscript: look up a script, with side effects
 //
-byte findscript(char *idbuf) {
+byte findscript(char *name) {
 
 	// script function in eeprom?
-	if ((symval=findKey(idbuf)) >= 0) sym = s_script_eeprom;
+	if ((CTX(symval)=findKey(name)) >= 0) CTX(sym) = s_script_eeprom;
 
 #if !defined(TINY_BUILD)
 	// script function in a file?
-	else if (scriptfileexists(idbuf)) sym = s_script_file;
+	else if (scriptfileexists(name)) CTX(sym) = s_script_file;
 
 	// script in the built-ins table?
-	else if (findbuiltin(idbuf)) {;}
+	else if (findbuiltin(name)) {;}
 #endif
 
 	else {
-		sym = s_undef;		// huh?
+		CTX(sym) = s_undef;		// huh?
 		return 0;
 	}
-	return sym;
+	return CTX(sym);
 }
 
 
@@ -658,43 +1105,43 @@ void parsestring(void (*charFunc)(char)) {
 
 	for (;;) {
 
-		if (inchar == ASC_QUOTE) {				// found the string terminator
+		if (CTX(inchar) == ASC_QUOTE) {				// found the string terminator
 			fetchc();							// consume it so's we move along
 			break;								// done with the big loop
 		}
-		else if (inchar == ASC_BKSLASH) {		// bkslash escape conventions per K&R C
+		else if (CTX(inchar) == ASC_BKSLASH) {		// bkslash escape conventions per K&R C
 			fetchc();
-			switch (inchar) {
+			switch (CTX(inchar)) {
 
 				// pass-thrus
 				case ASC_QUOTE:				break;	// just a dbl quote, move along
 				case ASC_BKSLASH:			break;	// just a backslash, move along
 
 				// minor translations
-				case 'n': 	inchar = '\n';	break;
-				case 't': 	inchar = '\t';	break;
-				case 'r':	inchar = '\r';	break;
+				case 'n': 	CTX(inchar) = '\n';	break;
+				case 't': 	CTX(inchar) = '\t';	break;
+				case 'r':	CTX(inchar) = '\r';	break;
 
 				case 'x':			// bkslash x hexdigit hexdigit	
 					fetchc();
-					if (ishex(inchar)) {
-						byte firstnibble = hexval(inchar);
+					if (ishex(CTX(inchar))) {
+						byte firstnibble = hexval(CTX(inchar));
 						fetchc();
-						if (ishex(inchar)) {
-							inchar = hexval(inchar) + (firstnibble << 4);
+						if (ishex(CTX(inchar))) {
+							CTX(inchar) = hexval(CTX(inchar)) + (firstnibble << 4);
 							break;
 						}
 					}
 					unexpected(M_char);
-					inchar = 'x';
+					CTX(inchar) = 'x';
 					break;
 			}
 		}
 		// Process the character we just extracted
-		(*charFunc)(inchar);
+		(*charFunc)(CTX(inchar));
 
 		fetchc();
-		if (!inchar) unexpected(M_eof);		// get next else end of input before string terminator
+		if (!CTX(inchar)) unexpected(M_eof);		// get next else end of input before string terminator
 	}
 }
 
@@ -706,8 +1153,8 @@ void getexpression(void);
 //	Recursive descent parser, old-school style.
 //
 void getfactor(void) {
-numvar thesymval = symval;
-byte thesym = sym;
+numvar thesymval = CTX(symval);
+byte thesym = CTX(sym);
 	getsym();		// eat the sym we just saved
 
 	switch (thesym) {
@@ -716,19 +1163,17 @@ byte thesym = sym;
 			break;
 			
 		case s_nvar:
-			if (sym == s_equals) {		// assignment, push is after the break;
+			if (CTX(sym) == s_equals) {		// assignment, push is after the break;
 				getsym();
 				assignVar(thesymval, getnum());
 			}
-			else if (sym == s_incr) {	// postincrement nvar++
-				vpush(getVar(thesymval));
-				assignVar(thesymval, getVar(thesymval) + 1);
+			else if (CTX(sym) == s_incr) {	// postincrement nvar++
+				vpush(addVar(thesymval, 1) - 1);
 				getsym();
 				break;
 			}
-			else if (sym == s_decr) {	// postdecrement nvar--
-				vpush(getVar(thesymval));
-				assignVar(thesymval, getVar(thesymval) - 1);
+			else if (CTX(sym) == s_decr) {	// postdecrement nvar--
+				vpush(addVar(thesymval, -1) + 1);
 				getsym();
 				break;
 			}
@@ -753,50 +1198,48 @@ byte thesym = sym;
 			break;
 
 		case s_apin:					// analog pin reference like a0
-			if (sym == s_equals) { 		// digitalWrite or analogWrite
+			if (CTX(sym) == s_equals) { 		// digitalWrite or analogWrite
 				getsym();
 				analogWrite(thesymval, getnum());
-				vpush(expval);
+				vpush(CTX(expval));
 			}
 			else vpush(analogRead(thesymval));
 			break;
 
 		case s_dpin:					// digital pin reference like d1
-			if (sym == s_equals) { 		// digitalWrite or analogWrite
+			if (CTX(sym) == s_equals) { 		// digitalWrite or analogWrite
 				getsym();
 				digitalWrite(thesymval, getnum());
-				vpush(expval);
+				vpush(CTX(expval));
 			}
 			else vpush(digitalRead(thesymval));
 			break;
 
 		case s_incr:
-			if (sym != s_nvar) expected(M_var);
-			assignVar(symval, getVar(symval) + 1);
-			vpush(getVar(symval));
+			if (CTX(sym) != s_nvar) expected(M_var);
+			vpush(addVar(CTX(symval), 1));
 			getsym();
 			break;
 
 		case s_decr:		// pre decrement
-			if (sym != s_nvar) expected(M_var);
-			assignVar(symval, getVar(symval) - 1);
-			vpush(getVar(symval));
+			if (CTX(sym) != s_nvar) expected(M_var);
+			vpush(addVar(CTX(symval), -1));
 			getsym();
 			break;
 
 		case s_arg:			// arg(n) - argument value
-			if (sym != s_lparen) expectedchar(s_lparen);
+			if (CTX(sym) != s_lparen) expectedchar(s_lparen);
 			getsym(); 		// eat '('
 			vpush(getarg(getnum()));
-			if (sym != s_rparen) expectedchar(s_rparen);
+			if (CTX(sym) != s_rparen) expectedchar(s_rparen);
 			getsym();		// eat ')'
 			break;
 
 		case s_lparen:  // expression in parens
 			getexpression();
-			if (exptype != s_nval) expected(M_number);
-			if (sym != s_rparen) missing(M_rparen);
-			vpush(expval);
+			if (CTX(exptype) != s_nval) expected(M_number);
+			if (CTX(sym) != s_rparen) missing(M_rparen);
+			vpush(CTX(expval));
 			getsym();	// eat the )
 			break;
 
@@ -823,8 +1266,8 @@ byte thesym = sym;
 			break;
 
 		case s_bitand:		// &var gives address-of-var; &macro gives eeprom address of macro
-			if (sym == s_nvar) vpush((numvar) &vars[symval]);
-			else if (sym == s_script_eeprom) vpush(symval);
+			if (CTX(sym) == s_nvar) vpush((numvar) &vars[CTX(symval)]);
+			else if (CTX(sym) == s_script_eeprom) vpush(CTX(symval));
 			else expected(M_var);
 			getsym();		// eat the var reference
 			break;
@@ -839,11 +1282,11 @@ byte thesym = sym;
 *****/
 			getfactor();
 #if 0
-			if (sym == s_equals) {
+			if (CTX(sym) == s_equals) {
 				getsym();	// eat '='
 				getexpression();
-				* (volatile byte *) vpop() = (byte) expval;
-				vpush((numvar) (byte) expval);
+				* (volatile byte *) vpop() = (byte) CTX(expval);
+				vpush((numvar) (byte) CTX(expval));
 			} 
 			else 
 #endif
@@ -865,8 +1308,8 @@ byte thesym = sym;
 #ifdef USE_PARSEREDUCE
 void parseReduce(void (*parsefunc)(void), byte sym1, byte sym2, byte sym3) {
 	(*parsefunc)();
-	while ((sym == sym1) || (sym == sym2) || (sym == sym3)) {
-		byte op = sym;
+	while ((CTX(sym) == sym1) || (CTX(sym) == sym2) || (CTX(sym) == sym3)) {
+		byte op = CTX(sym);
 		getsym();
 		(*parsefunc)();
 		vop(op);
@@ -880,8 +1323,8 @@ void getterm(void) {
 	parseReduce(&getfactor, s_mul, s_div, s_mod);
 #else
 	getfactor();
-	while ((sym == s_mul) || (sym == s_div) || (sym == s_mod)) {
-		byte op = sym;
+	while ((CTX(sym) == s_mul) || (CTX(sym) == s_div) || (CTX(sym) == s_mod)) {
+		byte op = CTX(sym);
 		getsym();
 		getfactor();
 		vop(op);
@@ -894,8 +1337,8 @@ void getsimpexp(void) {
 	parseReduce(&getterm, s_add, s_sub, s_sub);
 #else
 	getterm();
-	while ((sym == s_add) || (sym == s_sub)) {
-		byte op = sym;
+	while ((CTX(sym) == s_add) || (CTX(sym) == s_sub)) {
+		byte op = CTX(sym);
 		getsym();
 		getterm();
 		vop(op);
@@ -908,8 +1351,8 @@ void getshiftexp(void) {
 	parseReduce(&getsimpexp, s_shiftright, s_shiftleft, s_shiftleft);
 #else
 	getsimpexp();
-	while ((sym == s_shiftright) || (sym == s_shiftleft)) {
-		byte op = sym;
+	while ((CTX(sym) == s_shiftright) || (CTX(sym) == s_shiftleft)) {
+		byte op = CTX(sym);
 		getsym();
 		getsimpexp();
 		vop(op);
@@ -920,7 +1363,7 @@ void getshiftexp(void) {
 void getrelexp(void) {
 	getshiftexp();
 	while (isrelop()) {
-		byte op = sym;
+		byte op = CTX(sym);
 		getsym();
 		getshiftexp();
 		vop(op);
@@ -932,8 +1375,8 @@ void getbitopexp(void) {
 	parseReduce(&getrelexp, s_bitand, s_bitor, s_xor);
 #else
 	getrelexp();
-	while ((sym == s_bitand) || (sym == s_bitor) || (sym == s_xor)) {
-		byte op = sym;
+	while ((CTX(sym) == s_bitand) || (CTX(sym) == s_bitor) || (CTX(sym) == s_xor)) {
+		byte op = CTX(sym);
 		getsym();
 		getrelexp();
 		vop(op);
@@ -948,22 +1391,22 @@ void getexpression(void) {
 	parseReduce(&getbitopexp, s_logicaland, s_logicalor, s_logicalor);
 #else
 	getbitopexp();
-	while ((sym == s_logicaland) || (sym == s_logicalor)) {
-		byte op = sym;
+	while ((CTX(sym) == s_logicaland) || (CTX(sym) == s_logicalor)) {
+		byte op = CTX(sym);
 		getsym();
 		getbitopexp();
 		vop(op);
 	}
 #endif
-	exptype = s_nval;
-	expval = vpop();
+	CTX(exptype) = s_nval;
+	CTX(expval) = vpop();
 }
 
 
 // Get a number from the input stream.  Result to expval.
 numvar getnum(void) {
 	getexpression();
-	if (exptype != s_nval) expected(M_number);
-	return expval;
+	if (CTX(exptype) != s_nval) expected(M_number);
+	return CTX(expval);
 }
 
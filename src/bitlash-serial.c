@@ -325,12 +325,14 @@ void printBinary(unumvar n) { printIntegerInBase(n, 2, 0, '0'); }
 
 #if defined(UNIX_BUILD)
 
+// ^C comes in as SIGINT or in the input stream; pollinput() looks for both
 void chkbreak(void) {
 	extern byte break_received;
+	if (!(++CTX(polls) & 63)) pollinput();		// a system call, so not every statement
 	if (break_received) {
 		break_received = 0;
 		msgpl(M_ctrlc);
-		longjmp(env, X_EXIT);
+		longjmp(CTX(env), X_EXIT);
 	}
 }
 
@@ -341,7 +343,7 @@ void chkbreak(void) {
 	if (serialAvailable()) {		// allow ^C to break out
 		if (serialRead() == 3) {	// BUG: this gobblesnarfs input characters! - need serialPeek()
 			msgpl(M_ctrlc);
-			longjmp(env, X_EXIT);
+			longjmp(CTX(env), X_EXIT);
 		}
 	}
 	if (func_free() < MINIMUM_FREE_RAM) overflow(M_stack);
@@ -360,48 +362,48 @@ void cmd_print(void) {
 
 #ifdef SOFTWARE_SERIAL_TX
 		// print #2: expr,expr,...
-		if (sym == s_pound) {
+		if (CTX(sym) == s_pound) {
 			getsym();
 			byte pin = getnum();		// pin to print to
-			if (sym != s_colon) expectedchar(':');
+			if (CTX(sym) != s_colon) expectedchar(':');
 			getsym();					// eat :
 			setOutput(pin);
 		}
 #endif
 
 		// Special handling for quoted strings
-		if (sym == s_quote) {	// parse it and push it out the output hole (spb)
+		if (CTX(sym) == s_quote) {	// parse it and push it out the output hole (spb)
 			parsestring(&spb);	// munch through the string (incl. closing quote) spewing it via spb
 			getsym();			// and prime up the next symbol after for the comma check
 		} 
-		else if ((sym != s_semi) && (sym != s_eof))  {
+		else if ((CTX(sym) != s_semi) && (CTX(sym) != s_eof))  {
 			getexpression();
 
 			// format specifier: :x :b
-			if (sym == s_colon) {
+			if (CTX(sym) == s_colon) {
 				getsym();		// cheat and look for var ref to x or b
-				if (sym == s_nvar) {
-					if 		(symval == 'x'-'a') printHex((unumvar) expval);		// :x print hex
+				if (CTX(sym) == s_nvar) {
+					if 		(CTX(symval) == 'x'-'a') printHex((unumvar) CTX(expval));		// :x print hex
 #if !defined(TINY_BUILD)
-					else if (symval == 'b'-'a') printBinary((unumvar) expval);	// :b print binary
+					else if (CTX(symval) == 'b'-'a') printBinary((unumvar) CTX(expval));	// :b print binary
 #endif
-					else if (symval == 'y'-'a') spb(expval);					// :y print byte
-					else if (symval == 's'-'a') sp((char *)expval);				// :s print string
+					else if (CTX(symval) == 'y'-'a') spb(CTX(expval));					// :y print byte
+					else if (CTX(symval) == 's'-'a') sp((char *)CTX(expval));				// :s print string
 				}
-				else if (sym > ' ') while (expval-- > 0) spb(sym);	// any litsym
+				else if (CTX(sym) > ' ') while (CTX(expval)-- > 0) spb(CTX(sym));	// any litsym
 				else expected(M_pfmts);
 				getsym();
 			}
-			else printInteger(expval, 0, 0);
+			else printInteger(CTX(expval), 0, 0);
 		}
-		if ((sym == s_semi) || (sym == s_eof)) {
+		if ((CTX(sym) == s_semi) || (CTX(sym) == s_eof)) {
 			speol();
 			break;
 		}
-		if (sym == s_comma) {
+		if (CTX(sym) == s_comma) {
 			//if (inchar ==' ') 	// significant whitespace?! ha ha ha ha ha!
 			getsym();
-			if ((sym == s_semi) || (sym == s_eof)) break;	// trailing comma: no crlf
+			if ((CTX(sym) == s_semi) || (CTX(sym) == s_eof)) break;	// trailing comma: no crlf
 			spb(' ');
 		}
 	}
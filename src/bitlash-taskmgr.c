@@ -37,17 +37,1456 @@
 
 
 // Background task manager
-#define NUMTASKS 10
+#if !defined(BITLASH_CONTEXT)
 byte background;
+taskid curtask;
+#endif
 byte suspendBackground;
-byte curtask;
+
+#define SLOT_FREE -1
+
+// With worker threads, the task table is shared among the workers.
+// Idle workers wait on taskwake until the next task is due, and are
+// woken early when a task is started or the schedule changes.
+#ifdef TASK_WORKERS
+#include <pthread.h>
+pthread_mutex_t tasklock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t taskwake;
+#define locktasks() pthread_mutex_lock(&tasklock)
+#define unlocktasks() pthread_mutex_unlock(&tasklock)
+#define wakeworker() pthread_cond_signal(&taskwake)
+#define wakeworkers() pthread_cond_broadcast(&taskwake)
+pthread_once_t taskwakeonce = PTHREAD_ONCE_INIT;
+
+// time the waits on the monotonic clock so setting the date can't stall them
+void inittaskwake(void) {
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&taskwake, &attr);
+	pthread_condattr_destroy(&attr);
+}
+#else
+#define locktasks()
+#define unlocktasks()
+#define wakeworker()
+#define wakeworkers()
+#endif
+
+
+#if defined(TASK_TABLE)
+//////////
+//
+//	Task table
+//
+//	The task table comes from the heap and setTaskLimit() resizes it.
+//	Free slots are kept on a free list.  Tasks waiting to run are kept 
+//	in a run queue: a binary heap, or with TASK_WHEEL a timer wheel.
+//
+//	A task is busy, and out of the run queue, while it runs.  No one else 
+//	picks it up, and its slot is not reused until the run is over.
+//
+#ifdef TASK_COROUTINES
+struct coroutine;
+#endif
+#ifdef TASK_LATENCY
+// run times; see Run time histograms below
+#define LATSUB 3					// 2^LATSUB buckets to a power of two
+#define LATBUCKETS ((33 - LATSUB) << LATSUB)
+
+typedef struct histogram {
+	unsigned long count;
+	unsigned long max;
+	unsigned long buckets[LATBUCKETS];
+} histogram;
+#endif
+
+// a task's script, resolved when the task is started
+typedef struct {
+	byte type;						// SCRIPT_EEPROM, _PROGMEM, _FILE or _FUNCTION
+	numvar addr;					// EEPROM function id, PROGMEM text, or function entry
+	char name[IDLEN+1];				// to open a file script, and for ps
+} scriptref;
+
+typedef struct {
+	int macroid;					// EEPROM address of the function, 0 for other scripts
+	scriptref script;
+	numvar snoozetime;				// time between task invocations
+	unsigned long waketime;			// millis() time this task is eligible to run
+#if defined(TASK_WHEEL)
+	int queue;						// wheel list it is on, or -1
+	int next, prev;					// links in that list
+#else
+	int heappos;					// index in taskheap, or -1
+#endif
+	int nextfree;					// free list link
+	byte busy;						// running now
+	byte rate;						// RATE_DELAY, or a fixed-rate catch-up policy
+	int prio;						// higher runs first when several are due
+	int readypos;					// index in readyheap, or -1
+
+	// event trigger, if any, in place of a period
+	byte trigger;					// TRIG_NONE or what it waits for
+	byte trigpin;					// pin or variable it watches
+	byte armed;						// on the armed list, waiting for it
+	numvar threshold;				// for an analog pin
+	numvar last;					// level when it was last looked at
+	int nexttrig, prevtrig;			// armed list links
+#ifdef TASK_COROUTINES
+	byte yields;					// has called delay(), so runs as a coroutine
+	struct coroutine *co;			// its suspended run, if any
+#endif
+
+	// drift statistics, for ps
+	unsigned long runs;
+	unsigned long latesum;			// total ms it started late
+	unsigned long latemax;			// worst ms it started late
+	unsigned long missed;			// periods dropped by skip or coalesce
+	unsigned long overdue;			// runs that ended after the next period began
+
+	// budget per run, 0 for none, and the runs that went over it
+	unsigned long maxsteps;
+	unsigned long maxus;
+	unsigned long overruns;
+
+#ifdef TASK_LATENCY
+	struct histogram *lat;			// its run times, from its first run
+#endif
+} task;
+
+task *tasks;
+int numtasks;						// size of the task table
+int freetask = -1;					// head of the free list
+
+
+#if defined(TASK_WHEEL)
+//////////
+//
+//	Hierarchical timer wheel
+//
+//	Four wheels of 256 lists at 1 ms resolution.  A task goes on the 
+//	innermost wheel whose span covers its wake time; when the inner wheel 
+//	comes round to 0 the next list out is cascaded down into it.  Inserting
+//	and removing a task is O(1), and each tick moves its whole list to the 
+//	ready list at once.
+//
+#define WHEELBITS 8
+#define WHEELSIZE (1 << WHEELBITS)
+#define WHEELMASK (WHEELSIZE - 1)
+#define WHEELLEVELS 4
+#define READYQ 0					// list 0 is the ready list; the wheels follow
+#define wheelq(level, t) (1 + ((level) * WHEELSIZE) + ((t) & WHEELMASK))
+
+typedef struct {
+	int head, tail;
+} taskq;
+
+taskq wheel[1 + (WHEELLEVELS * WHEELSIZE)];
+unsigned long wheeltime;			// the next tick to process
+int wheeled;						// tasks on the wheels, not counting ready ones
+
+void qappend(int q, int slot) {
+	tasks[slot].queue = q;
+	tasks[slot].next = -1;
+	tasks[slot].prev = wheel[q].tail;
+	if (wheel[q].tail >= 0) tasks[wheel[q].tail].next = slot;
+	else wheel[q].head = slot;
+	wheel[q].tail = slot;
+	if (q != READYQ) wheeled++;
+}
+
+void queueremove(int slot) {
+	task *t = &tasks[slot];
+	if (t->prev >= 0) tasks[t->prev].next = t->next;
+	else wheel[t->queue].head = t->next;
+	if (t->next >= 0) tasks[t->next].prev = t->prev;
+	else wheel[t->queue].tail = t->prev;
+	if (t->queue != READYQ) wheeled--;
+	t->queue = -1;
+}
+
+void queueinsert(int slot) {
+	unsigned long when = tasks[slot].waketime;
+	signed long delta = when - wheeltime;
+	if (delta < 0) qappend(READYQ, slot);
+	else if (delta < (1L << 8)) qappend(wheelq(0, when), slot);
+	else if (delta < (1L << 16)) qappend(wheelq(1, when >> 8), slot);
+	else if (delta < (1L << 24)) qappend(wheelq(2, when >> 16), slot);
+	else {
+		// beyond the outer wheel: park it a full turn out; it is re-filed on the way in
+		if (delta > 0xffffffffL) when = wheeltime + 0xffffffffL;
+		qappend(wheelq(3, when >> 24), slot);
+	}
+}
+
+void queueclear(void) {
+	int q;
+	for (q = 0; q < 1 + (WHEELLEVELS * WHEELSIZE); q++) wheel[q].head = wheel[q].tail = -1;
+	wheeled = 0;
+	wheeltime = millis();
+}
+
+// re-file every task on a list against the current wheeltime
+void cascade(int q) {
+	int slot = wheel[q].head;
+	wheel[q].head = wheel[q].tail = -1;
+	while (slot >= 0) {
+		int next = tasks[slot].next;
+		wheeled--;
+		queueinsert(slot);
+		slot = next;
+	}
+}
+
+// run the wheel up to now, moving expired tasks to the ready list
+void advancewheel(unsigned long now) {
+	if (!wheeled) {			// nothing on the wheels: skip ahead
+		wheeltime = now + 1;
+		return;
+	}
+	while ((signed long) (now - wheeltime) >= 0) {
+		unsigned long t = wheeltime;
+		if (!(t & WHEELMASK)) {
+			cascade(wheelq(1, t >> 8));
+			if (!((t >> 8) & WHEELMASK)) {
+				cascade(wheelq(2, t >> 16));
+				if (!((t >> 16) & WHEELMASK)) cascade(wheelq(3, t >> 24));
+			}
+		}
+		int q = wheelq(0, t);
+		int slot;
+		while ((slot = wheel[q].head) >= 0) {
+			queueremove(slot);
+			qappend(READYQ, slot);
+		}
+		wheeltime++;
+	}
+}
+
+// take a due task off the ready list, or return -1
+int queuepop(unsigned long now) {
+	advancewheel(now);
+	int slot = wheel[READYQ].head;
+	if (slot >= 0) queueremove(slot);
+	return slot;
+}
+
+// millis until the next task may be due, up to the next cascade
+long queuewait(unsigned long now) {
+	advancewheel(now);
+	if (wheel[READYQ].head >= 0) return 0;
+	// at the top of a turn the outer lists have yet to cascade: stop there
+	long turn = (wheeltime & WHEELMASK) ? WHEELSIZE - (long) (wheeltime & WHEELMASK) : 0;
+	long ticks;
+	for (ticks = 0; ticks < turn; ticks++) {
+		if (wheel[wheelq(0, wheeltime + ticks)].head >= 0) break;
+	}
+	return (wheeltime + ticks) - now;
+}
+
+byte queueempty(void) { return !wheeled && (wheel[READYQ].head < 0); }
+
+
+#else	// TASK_HEAP
+//////////
+//
+//	Binary min-heap ordered by waketime
+//
+//	Finding the next task, adding one and removing one are O(log n).
+//
+int *taskheap;						// the run queue: slots ordered by waketime
+int heapsize;						// tasks in the run queue
+
+#define wakesbefore(a, b) ((signed long) (tasks[a].waketime - tasks[b].waketime) < 0)
+
+void heapset(int i, int slot) {
+	taskheap[i] = slot;
+	tasks[slot].heappos = i;
+}
+
+void heapup(int i, int slot) {
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!wakesbefore(slot, taskheap[parent])) break;
+		heapset(i, taskheap[parent]);
+		i = parent;
+	}
+	heapset(i, slot);
+}
+
+void heapdown(int i, int slot) {
+	for (;;) {
+		int child = (2 * i) + 1;
+		if (child >= heapsize) break;
+		if ((child + 1 < heapsize) && wakesbefore(taskheap[child + 1], taskheap[child])) child++;
+		if (!wakesbefore(taskheap[child], slot)) break;
+		heapset(i, taskheap[child]);
+		i = child;
+	}
+	heapset(i, slot);
+}
+
+void queueinsert(int slot) {
+	heapup(heapsize++, slot);
+}
+
+void queueremove(int slot) {
+	int i = tasks[slot].heappos;
+	tasks[slot].heappos = -1;
+	if (--heapsize == i) return;		// it was the last one
+	int last = taskheap[heapsize];
+	heapup(i, last);
+	heapdown(tasks[last].heappos, last);
+}
+
+void queueclear(void) {
+	heapsize = 0;
+}
+
+// take a due task off the heap, or return -1
+int queuepop(unsigned long now) {
+	if (!heapsize || ((signed long) (now - tasks[taskheap[0]].waketime) < 0)) return -1;
+	int slot = taskheap[0];
+	queueremove(slot);
+	return slot;
+}
+
+// millis until the next task is due
+long queuewait(unsigned long now) {
+	if (!heapsize) return 500L;
+	return (signed long) (tasks[taskheap[0]].waketime - now);
+}
+
+byte queueempty(void) { return !heapsize; }
+#endif	// TASK_WHEEL
+
+
+//////////
+//
+//	Ready heap
+//
+//	When more than one task is due, claimTask() moves them all here and 
+//	takes the one with the highest priority.  Among equals the one that 
+//	woke first goes first, or with TASK_EDF the one with the earliest 
+//	deadline: the end of its period.  With just one task due, as is usual,
+//	this is skipped.
+//
+int *readyheap;
+int readysize;
+
+#define deadline(t) ((t)->waketime + (t)->snoozetime)
+
+byte runsbefore(int a, int b) {
+	task *ta = &tasks[a], *tb = &tasks[b];
+	if (ta->prio != tb->prio) return ta->prio > tb->prio;
+#if defined(TASK_EDF)
+	return (signed long) (deadline(ta) - deadline(tb)) < 0;
+#else
+	return (signed long) (ta->waketime - tb->waketime) < 0;
+#endif
+}
+
+void readyset(int i, int slot) {
+	readyheap[i] = slot;
+	tasks[slot].readypos = i;
+}
+
+void readyup(int i, int slot) {
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!runsbefore(slot, readyheap[parent])) break;
+		readyset(i, readyheap[parent]);
+		i = parent;
+	}
+	readyset(i, slot);
+}
+
+void readydown(int i, int slot) {
+	for (;;) {
+		int child = (2 * i) + 1;
+		if (child >= readysize) break;
+		if ((child + 1 < readysize) && runsbefore(readyheap[child + 1], readyheap[child])) child++;
+		if (!runsbefore(readyheap[child], slot)) break;
+		readyset(i, readyheap[child]);
+		i = child;
+	}
+	readyset(i, slot);
+}
+
+void readyinsert(int slot) {
+	readyup(readysize++, slot);
+}
+
+void readyremove(int slot) {
+	int i = tasks[slot].readypos;
+	tasks[slot].readypos = -1;
+	if (--readysize == i) return;
+	int last = readyheap[readysize];
+	readyup(i, last);
+	readydown(tasks[last].readypos, last);
+}
+
+int readypop(void) {
+	if (!readysize) return -1;
+	int slot = readyheap[0];
+	readyremove(slot);
+	return slot;
+}
+
+// take a task out of whichever queue it is in
+void unqueue(int slot) {
+	if (tasks[slot].armed) return;		// freeslot() takes it off the armed list
+	if (tasks[slot].readypos >= 0) readyremove(slot);
+	else queueremove(slot);
+}
+
+
+//////////
+//
+//	Event triggers
+//
+//	A task with a trigger has no period.  It waits on the armed list
+//	until its pin, variable or the serial input changes the way it asks,
+//	and then it is queued to run right away.  After the run it is armed 
+//	again; a change while it ran fires it again at once.
+//
+//	The armed list is looked over on each claimTask(), which is after 
+//	every command and task run, so a change made by a script is seen 
+//	straight away.  The Unix pins call checkTriggers() when they change
+//	and the event loop wakes for input, so nothing there needs polling.
+//	A build whose pins change by themselves defines TRIGPOLL, and then
+//	the wait is cut to TRIGPOLL ms while a task is armed on a pin.
+//
+int armed = -1;						// head of the armed list
+int inputtasks;						// tasks triggered by serial input
+#ifdef TRIGPOLL
+int pintasks;						// armed tasks watching a pin
+#define onpin(t) (((t)->trigger != TRIG_VAR) && ((t)->trigger != TRIG_INPUT))
+#endif
+
+void arm(int slot) {
+	task *t = &tasks[slot];
+	t->armed = 1;
+	t->prevtrig = -1;
+	t->nexttrig = armed;
+	if (armed >= 0) tasks[armed].prevtrig = slot;
+	armed = slot;
+#ifdef TRIGPOLL
+	if (onpin(t)) pintasks++;
+#endif
+}
+
+void disarm(int slot) {
+	task *t = &tasks[slot];
+	if (t->prevtrig >= 0) tasks[t->prevtrig].nexttrig = t->nexttrig;
+	else armed = t->nexttrig;
+	if (t->nexttrig >= 0) tasks[t->nexttrig].prevtrig = t->prevtrig;
+	t->armed = 0;
+#ifdef TRIGPOLL
+	if (onpin(t)) pintasks--;
+#endif
+}
+
+void cleartrigger(task *t) {
+	if (t->trigger == TRIG_INPUT) inputtasks--;
+	t->trigger = TRIG_NONE;
+}
+
+// has t's trigger tripped since it was last looked at?
+byte tripped(task *t) {
+	numvar level;
+	if (t->trigger == TRIG_INPUT) return serialAvailable() > 0;
+	else if (t->trigger == TRIG_VAR) level = getVar(t->trigpin);
+	else if (t->trigger == TRIG_ABOVE) level = analogRead(t->trigpin) > t->threshold;
+	else if (t->trigger == TRIG_BELOW) level = analogRead(t->trigpin) < t->threshold;
+	else level = digitalRead(t->trigpin);
+	numvar was = t->last;
+	t->last = level;
+	if (t->trigger == TRIG_RISING) return level && !was;
+	if (t->trigger == TRIG_FALLING) return !level && was;
+	if ((t->trigger == TRIG_ABOVE) || (t->trigger == TRIG_BELOW)) return level && !was;
+	return level != was;			// TRIG_CHANGE, TRIG_VAR
+}
+
+// queue the armed tasks whose triggers have tripped
+void checktriggers(unsigned long now) {
+	int slot = armed;
+	while (slot >= 0) {
+		int next = tasks[slot].nexttrig;
+		if (tripped(&tasks[slot])) {
+			disarm(slot);
+			tasks[slot].waketime = now;
+			queueinsert(slot);
+		}
+		slot = next;
+	}
+}
+
+// for a pin layer that knows when a pin changes
+void checkTriggers(void) {
+	locktasks();
+	if (armed >= 0) {
+		checktriggers(millis());
+		wakeworkers();
+	}
+	unlocktasks();
+}
+
+
+void freeslot(int slot) {
+	if (tasks[slot].armed) disarm(slot);
+	cleartrigger(&tasks[slot]);
+	tasks[slot].macroid = SLOT_FREE;
+	tasks[slot].nextfree = freetask;
+	freetask = slot;
+}
+
+// rebuild the free list in slot order, so new tasks get low numbers
+void rebuildfreelist(void) {
+	int slot;
+	freetask = -1;
+	for (slot = numtasks - 1; slot >= 0; slot--) {
+		if ((tasks[slot].macroid == SLOT_FREE) && !tasks[slot].busy) {
+			tasks[slot].nextfree = freetask;
+			freetask = slot;
+		}
+	}
+}
+
+
+//////////
+//
+//	Budgets
+//
+//	A task may be given a budget of statements and of microseconds per run,
+//	which getstatement() checks as it goes.  A task over budget is preempted:
+//	on a coroutine it yields, to be resumed after the tasks that are due;
+//	otherwise its run is cut short and it is rescheduled as usual.
+//	Each time counts as an overrun in ps.
+//
+#if !defined(BITLASH_CONTEXT)
+byte budgeted;						// the running task has a budget
+unsigned long stepsrun;				// statements so far this run
+unsigned long stepbudget, usbudget;
+unsigned long runstart;				// micros() when the run started
+#endif
+
+// run a task's script once, with the background flag set
+void runscript(taskid slot, scriptref *script) {
+	CTX(background) = 1;
+	CTX(curtask) = slot;
+	numvar addr = script->addr;
+	if (script->type == SCRIPT_EEPROM) addr = findend(addr);
+	if (script->name[0] && (script->type != SCRIPT_FUNCTION)) {
+		// run it in a frame of its own name, as if it were called: a file
+		// script finds its way back to its file by it, after a while loop
+		// or a call, and traceback and the profiler see the task's function
+		strcpy(CTX(idbuf), script->name);
+		CTX(sym) = s_eof;
+		parsearglist(1);
+		numvar *frame = CTX(arg);
+		execscript(script->type, addr, script->name);
+		if (CTX(arg) == frame) releaseargblock();	// an error has already dropped it
+	}
+	else execscript(script->type, addr, script->name);
+	CTX(background) = CTX(budgeted) = 0;
+}
+
+// start the budget for a run of t, in the context that will run it
+void startbudget(task *t) {
+	CTX(stepbudget) = t->maxsteps;
+	CTX(usbudget) = t->maxus;
+	CTX(budgeted) = (CTX(stepbudget) || CTX(usbudget));
+	CTX(stepsrun) = 0;
+	if (CTX(usbudget)) CTX(runstart) = micros();
+}
+
+#ifdef TASK_COROUTINES
+//////////
+//
+//	Coroutines
+//
+//	A task that calls delay() runs on a coroutine: a stack and an 
+//	interpreter context of its own.  delay() then saves the whole run,
+//	parse point, value stack and all, by switching back to the scheduler,
+//	and the task goes back in the run queue to be resumed when it is due.
+//
+//	Tasks that never yield run on the scheduler's stack as before, since
+//	switching stacks costs a few hundred ns.  mayYield() looks for the
+//	calls in the function's text when the task starts; a task that gets
+//	there some other way is found out at its first delay(), which blocks.
+//
+#include <ucontext.h>
+#define TASKSTACK (256 * 1024L)			// only the pages touched are used
+
+typedef struct coroutine {
+	ucontext_t uc;
+	bitlash_ctx *ctx;
+	taskid slot;
+	scriptref script;
+	unsigned long waketime;				// of the run, for reschedule()
+	unsigned long resumetime;			// when to resume it
+	byte done;
+	byte keywait;						// waiting in getkey() or getnum()
+	struct coroutine *nextfree;
+} coroutine;
+
+ucontext_t scheduler;
+coroutine *curco;						// the one running now, if any
+coroutine *freeco;						// pool of idle ones
+int keywaiters;							// how many wait for serial input
+
+coroutine *newcoroutine(void) {
+	coroutine *co = freeco;
+	if (co) {
+		freeco = co->nextfree;
+		return co;
+	}
+	co = (coroutine *) malloc(sizeof(coroutine));
+	if (!co) return 0;
+	void *stack = malloc(TASKSTACK);
+	co->ctx = bitlash_ctx_new();
+	if (!stack || !co->ctx || (getcontext(&co->uc) != 0)) {
+		free(stack);
+		if (co->ctx) bitlash_ctx_free(co->ctx);
+		free(co);
+		return 0;
+	}
+	co->uc.uc_stack.ss_sp = stack;
+	co->uc.uc_stack.ss_size = TASKSTACK;
+	co->uc.uc_link = 0;
+	return co;
+}
+
+void freecoroutine(coroutine *co) {
+	co->nextfree = freeco;
+	freeco = co;
+}
+
+// discard the suspended run of a stopped task
+void dropcoroutine(task *t) {
+	coroutine *co = t->co;
+	if (!co) return;
+	t->co = 0;
+	if (co->keywait) keywaiters--;
+	// its context is left mid-run; start the next one with a fresh context
+	bitlash_ctx *ctx = bitlash_ctx_new();
+	if (!ctx) return;				// leak it rather than reuse it
+	bitlash_ctx_free(co->ctx);
+	co->ctx = ctx;
+	freecoroutine(co);
+}
+
+void coroutinemain(void) {
+	coroutine *co = curco;
+	runscript(co->slot, &co->script);
+	co->done = 1;
+	swapcontext(&co->uc, &scheduler);	// not resumed; the next run makes a new context
+}
+
+// start or resume the run of a task on its coroutine
+// returns true if the task yielded, and is back in the run queue
+byte resumeTask(taskid slot, scriptref *script) {
+	task *t = &tasks[slot];
+	coroutine *co = t->co;
+	if (!co) {
+		co = newcoroutine();
+		if (!co) {					// out of memory: run it the old way
+			startbudget(t);
+			runscript(slot, script);
+			return 0;
+		}
+		co->slot = slot;
+		co->script = *script;
+		co->waketime = t->waketime;
+		co->done = 0;
+		co->keywait = 0;
+		makecontext(&co->uc, coroutinemain, 0);
+		t->co = co;
+	}
+
+	bitlash_ctx *prev = bitlash_setctx(co->ctx);
+	startbudget(t);					// a fresh budget each time it resumes
+	curco = co;
+	swapcontext(&scheduler, &co->uc);
+	curco = 0;
+	bitlash_setctx(prev);
+
+	t = &tasks[slot];				// the table may have been resized
+	if (co->done) {
+		t->co = 0;
+		t->waketime = co->waketime;
+		freecoroutine(co);
+		return 0;
+	}
+	t->busy = 0;
+	if (t->macroid == SLOT_FREE) {	// stopped while it ran
+		dropcoroutine(t);
+		freeslot(slot);
+	}
+	else {
+		t->waketime = co->resumetime;
+		queueinsert(slot);
+	}
+	return 1;
+}
+
+//////////
+//
+//	yieldTask
+//
+//	Suspends the task that is running for ms milliseconds
+//	Returns false if the caller should block instead: in the foreground,
+//	or in a task not yet known to yield
+//
+byte yieldTask(unsigned long ms) {
+	if (!CTX(background)) return 0;
+	coroutine *co = curco;
+	if (!co) {
+		tasks[CTX(curtask)].yields = 1;	// a coroutine from the next run on
+		return 0;
+	}
+	co->resumetime = millis() + ms;
+	parsepoint here;
+	markparsepoint(&here);			// others may read the script file meanwhile
+	swapcontext(&co->uc, &scheduler);
+	if (here.type == SCRIPT_FILE) {
+		// reopen it where we were: the file of the function we are in,
+		// or at the top level the task's own
+		char *name = argname(CTX(arg));
+		initparsepoint(SCRIPT_FILE, here.ptr, name ? name : co->script.name);
+	}
+	return 1;
+}
+
+// does the function at macroid call delay(), getkey() or getnum(),
+// itself or in the functions it calls, down to depth levels?
+byte mayYield(int macroid, byte depth) {
+	char name[IDLEN+1];
+	int addr = findend(macroid);
+	while (addr <= E2END) {
+		byte c = eeread(addr);
+		if (!c) break;
+		if (c == '"') {				// skip strings
+			while ((++addr <= E2END) && (c = eeread(addr)) && (c != '"')) {;}
+			addr++;
+		}
+		else if (isalpha(c) || (c == '_')) {
+			int len = 0;
+			while (isalnum(c) || (c == '_')) {
+				if (len < IDLEN) name[len++] = tolower(c);
+				if (++addr > E2END) break;
+				c = eeread(addr);
+			}
+			name[len] = 0;
+			if (!strcmp(name, "delay") || !strcmp(name, "getkey") || !strcmp(name, "getnum")) return 1;
+			if (depth && (len > 1)) {
+				int id = findKey(name);
+				if ((id >= 0) && (id != macroid) && mayYield(id, depth - 1)) return 1;
+			}
+		}
+		else addr++;
+	}
+	return 0;
+}
+
+// wait for serial input; a task lets the others run meanwhile,
+// and the command line leaves the input to it
+void waitForKey(void) {
+	coroutine *co = curco;
+	if (CTX(background) && !co) tasks[CTX(curtask)].yields = 1;
+	if (!CTX(background) || !co) {
+		while (!serialAvailable()) {;}		// blocking!
+		return;
+	}
+	co->keywait = 1;
+	keywaiters++;
+	while (!serialAvailable()) yieldTask(10);
+	keywaiters--;
+	co->keywait = 0;
+}
+#endif	// TASK_COROUTINES
+
+//////////
+//
+//	setTaskBudget
+//
+//	Limits each run of a task to steps statements and us microseconds;
+//	0 is no limit
+//
+void setTaskBudget(taskid slot, unsigned long steps, unsigned long us) {
+	if ((slot < 0) || (slot >= numtasks)) return;
+	locktasks();
+	tasks[slot].maxsteps = steps;
+	tasks[slot].maxus = us;
+#ifdef TASK_COROUTINES
+	if (steps || us) tasks[slot].yields = 1;	// so it can be preempted
+#endif
+	unlocktasks();
+}
+
+// called from getstatement() while a task with a budget runs
+void chkbudget(void) {
+	++CTX(stepsrun);
+	if ((CTX(stepbudget) && (CTX(stepsrun) > CTX(stepbudget))) ||
+		(CTX(usbudget) && !(CTX(stepsrun) & 15) && ((micros() - CTX(runstart)) > CTX(usbudget)))) {
+		locktasks();
+		tasks[CTX(curtask)].overruns++;
+		unlocktasks();
+#ifdef TASK_COROUTINES
+		if (curco) {
+#if defined(UNIX_BUILD)
+			// the virtual clock stands still while scripts run, and would
+			// stay put with this task always due: charge it a tick instead
+			if (virtualtime) delay(1);
+#endif
+			yieldTask(0);			// resumes with a fresh budget
+			return;
+		}
+#endif
+		CTX(budgeted) = 0;
+		longjmp(CTX(env), X_BUDGET);
+	}
+}
+
+
+// resize the task table
+// returns false if out of memory or a task is running in a slot past n
+byte setTaskLimit(int n) {
+	int slot;
+	if (n < 1) return 0;
+	locktasks();
+	for (slot = n; slot < numtasks; slot++) {
+		if ((tasks[slot].macroid != SLOT_FREE) || tasks[slot].busy) {
+			unlocktasks();
+			return 0;
+		}
+	}
+	// make all the new arrays before giving up any of the old ones,
+	// so running out of memory leaves the table as it was
+	task *newtasks = (task *) malloc(n * sizeof(task));
+	int *newready = (int *) malloc(n * sizeof(int));
+	byte made = newtasks && newready;
+#if !defined(TASK_WHEEL)
+	int *newheap = (int *) malloc(n * sizeof(int));
+	made = made && newheap;
+	if (!made) free(newheap);
+#endif
+	if (!made) {
+		free(newtasks);
+		free(newready);
+		unlocktasks();
+		return 0;
+	}
+	int kept = (n < numtasks) ? n : numtasks;
+	if (kept) {
+		memcpy(newtasks, tasks, kept * sizeof(task));
+		memcpy(newready, readyheap, kept * sizeof(int));
+#if !defined(TASK_WHEEL)
+		memcpy(newheap, taskheap, kept * sizeof(int));
+#endif
+	}
+#ifdef TASK_LATENCY
+	for (slot = n; slot < numtasks; slot++) free(tasks[slot].lat);
+#endif
+	free(tasks);
+	tasks = newtasks;
+	free(readyheap);
+	readyheap = newready;
+#if !defined(TASK_WHEEL)
+	free(taskheap);
+	taskheap = newheap;
+#endif
+	for (slot = numtasks; slot < n; slot++) {
+		tasks[slot].macroid = SLOT_FREE;
+		tasks[slot].busy = 0;
+		tasks[slot].readypos = -1;
+		tasks[slot].trigger = TRIG_NONE;	// so cleartrigger() leaves inputtasks be
+		tasks[slot].armed = 0;
+#ifdef TASK_COROUTINES
+		tasks[slot].co = 0;
+#endif
+#ifdef TASK_LATENCY
+		tasks[slot].lat = 0;
+#endif
+	}
+	numtasks = n;
+	rebuildfreelist();
+	unlocktasks();
+	return 1;
+}
+
+void initTaskList(void) { 
+#ifdef TASK_WORKERS
+	// once, whether or not BITLASH_TASKS has made the table already
+	pthread_once(&taskwakeonce, inittaskwake);
+#endif
+	if (!tasks) setTaskLimit(NUMTASKS);
+	locktasks();
+	int slot;
+	for (slot = 0; slot < numtasks; slot++) {
+		tasks[slot].macroid = SLOT_FREE;	// a busy one is freed when its run is over
+		tasks[slot].armed = 0;				// the armed list is emptied below
+		if (!tasks[slot].busy) {
+			cleartrigger(&tasks[slot]);
+#ifdef TASK_COROUTINES
+			dropcoroutine(&tasks[slot]);
+#endif
+		}
+	}
+	queueclear();
+	readysize = 0;
+	armed = -1;
+#ifdef TRIGPOLL
+	pintasks = 0;
+#endif
+	rebuildfreelist();
+	wakeworkers();
+	unlocktasks();
+}
+
+void stopTask(taskid slot) { 
+	if ((slot < 0) || (slot >= numtasks)) return;
+	locktasks();
+	if (tasks[slot].macroid != SLOT_FREE) {
+		if (tasks[slot].busy) tasks[slot].macroid = SLOT_FREE;	// runTask frees it
+		else {
+			unqueue(slot);
+#ifdef TASK_COROUTINES
+			dropcoroutine(&tasks[slot]);
+#endif
+			freeslot(slot);
+		}
+		wakeworkers();
+	}
+	unlocktasks();
+	saveTasks();
+}
+
+// add task to run list; returns its slot
+taskid startTask(int macroid, numvar snoozems) {
+	return startScriptTask(SCRIPT_EEPROM, macroid, 0, snoozems);
+}
+
+//////////
+//
+//	startScriptTask
+//
+//	Starts a task running a script of any type: its type and address
+//	as the parser found them, and its name, which a file script needs
+//	Returns its slot
+//
+taskid startScriptTask(byte type, numvar addr, char *name, numvar snoozems) {
+	locktasks();
+	int slot = freetask;
+	if (slot < 0) {
+		unlocktasks();
+		overflow(M_id);
+	}
+	freetask = tasks[slot].nextfree;
+	task *t = &tasks[slot];
+	t->macroid = (type == SCRIPT_EEPROM) ? addr : 0;
+	t->script.type = type;
+	t->script.addr = (type == SCRIPT_FILE) ? 0 : addr;	// files run from the top
+	t->script.name[0] = 0;
+	if (name) strncpy(t->script.name, name, IDLEN);
+	t->script.name[IDLEN] = 0;
+	t->snoozetime = snoozems;
+	t->rate = RATE_DELAY;
+	t->prio = 0;
+	t->readypos = -1;
+	t->trigger = TRIG_NONE;
+	t->armed = 0;
+#ifdef TASK_COROUTINES
+	// C functions never yield; look for delay() in EEPROM functions,
+	// and let other scripts, which are costlier to look at, yield
+	if (type == SCRIPT_EEPROM) t->yields = mayYield(addr, 3);
+	else t->yields = (type != SCRIPT_FUNCTION);
+#endif
+	t->runs = t->latesum = t->latemax = t->missed = t->overdue = 0;
+	t->maxsteps = t->maxus = t->overruns = 0;
+#ifdef TASK_LATENCY
+	if (t->lat) memset(t->lat, 0, sizeof(histogram));
+#endif
+
+	// eligible to run at the end of 1 tick
+	t->waketime = millis() + snoozems;
+	queueinsert(slot);
+	wakeworker();
+	unlocktasks();
+	saveTasks();
+	return slot;
+}
+
+//////////
+//
+//	setTaskTrigger
+//
+//	Makes a task run when something happens instead of every so often:
+//	TRIG_CHANGE, TRIG_RISING or TRIG_FALLING on digital pin pin,
+//	TRIG_ABOVE or TRIG_BELOW threshold on analog pin pin,
+//	TRIG_VAR when variable number pin changes,
+//	TRIG_INPUT while there is serial input waiting
+//
+void setTaskTrigger(taskid slot, byte trigger, byte pin, numvar threshold) {
+	if ((slot < 0) || (slot >= numtasks)) return;
+	locktasks();
+	task *t = &tasks[slot];
+	if (t->macroid != SLOT_FREE) {
+		byte wasarmed = t->armed;
+		if (wasarmed) disarm(slot);		// off the list under its old trigger
+		cleartrigger(t);
+		t->trigger = trigger;
+		t->trigpin = pin;
+		t->threshold = threshold;
+		if (trigger == TRIG_INPUT) inputtasks++;
+		tripped(t);					// wait for a change from now
+		if (!t->busy) {
+			if (!wasarmed) unqueue(slot);
+			arm(slot);
+		}
+		wakeworkers();
+	}
+	unlocktasks();
+	saveTasks();
+}
+
+//////////
+//
+//	setTaskPriority
+//
+//	Of the tasks that are due, those of higher priority run first;
+//	the default is 0
+//
+void setTaskPriority(taskid slot, int prio) {
+	if ((slot < 0) || (slot >= numtasks)) return;
+	locktasks();
+	if (tasks[slot].readypos >= 0) {		// re-file it
+		readyremove(slot);
+		tasks[slot].prio = prio;
+		readyinsert(slot);
+	}
+	else tasks[slot].prio = prio;
+	unlocktasks();
+	saveTasks();
+}
+
+//////////
+//
+//	setTaskRate
+//
+//	RATE_DELAY, the default, schedules the next run snoozetime after
+//	this one ends, so the task drifts by its own run time every period.
+//	The fixed rate policies schedule it one period after the last wake
+//	time instead, and differ in what they do when the task falls behind:
+//
+//	RATE_BURST runs it back to back until it has caught up
+//	RATE_SKIP drops the missed periods and waits for the next one
+//	RATE_COALESCE runs it once for all the missed periods
+//
+void setTaskRate(taskid slot, byte rate) {
+	if ((slot < 0) || (slot >= numtasks)) return;
+	locktasks();
+	tasks[slot].rate = rate;
+	unlocktasks();
+	saveTasks();
+}
+
+// work out the next wake time after a run
+void reschedule(task *t) {
+	unsigned long now = millis();
+	unsigned long period = t->snoozetime;
+	if ((t->rate == RATE_DELAY) || ((numvar) period <= 0)) {
+		t->waketime = now + period;
+		return;
+	}
+	unsigned long next = t->waketime + period;
+	if ((signed long) (now - next) >= 0) {			// fallen behind
+		unsigned long behind = ((now - next) / period) + 1;	// periods due by now
+		if (t->rate == RATE_SKIP) {
+			next += behind * period;
+			t->missed += behind;
+		}
+		else if (t->rate == RATE_COALESCE) {
+			next += (behind - 1) * period;
+			t->missed += behind - 1;
+		}
+	}
+	t->waketime = next;
+}
+
+void snooze(unumvar duration) {
+	if (CTX(background)) {
+		locktasks();
+		tasks[CTX(curtask)].snoozetime = duration;
+		wakeworker();
+		unlocktasks();
+	}
+	else delay(duration);
+}
+
+//////////
+//
+//	Run time histograms
+//
+//	With TASK_LATENCY each command typed and each task run is timed, in us,
+//	into a histogram of its own.  As in HdrHistogram the buckets are 
+//	logarithmic, 8 to each power of two, so a percentile read from them is
+//	within 12.5% at any scale, from a few us to an hour, in 240 counts.
+//	A task's histogram comes from the heap at its first run.
+//
+//	A run of a task that calls delay() is timed from each resume to where it
+//	suspends again: the time it kept the others from running.
+//
+#ifdef TASK_LATENCY
+histogram cmdlat;					// commands, in the foreground
+
+int latbucket(unsigned long us) {
+	if (us > 0xffffffffUL) us = 0xffffffffUL;
+	if (us < (1 << LATSUB)) return us;
+	int mag = 31 - __builtin_clz((unsigned int) us);		// top bit
+	return ((mag - LATSUB + 1) << LATSUB) + ((us >> (mag - LATSUB)) & ((1 << LATSUB) - 1));
+}
+
+// the smallest and largest us counted in a bucket
+unsigned long latlow(int b) {
+	if (b < (2 << LATSUB)) return b;
+	int mag = (b >> LATSUB) + LATSUB - 1;
+	return (unsigned long) ((1 << LATSUB) + (b & ((1 << LATSUB) - 1))) << (mag - LATSUB);
+}
+unsigned long lathigh(int b) { return (b + 1 < LATBUCKETS) ? latlow(b + 1) - 1 : 0xffffffffUL; }
+
+void record(histogram *h, unsigned long us) {
+	h->count++;
+	if (us > h->max) h->max = us;
+	h->buckets[latbucket(us)]++;
+}
+
+// the run time that per10k in 10000 runs took no longer than
+unsigned long percentile(histogram *h, unsigned long per10k) {
+	unsigned long long target = (((unsigned long long) h->count * per10k) + 9999) / 10000;
+	unsigned long long seen = 0;
+	int b;
+	for (b = 0; b < LATBUCKETS - 1; b++) {
+		seen += h->buckets[b];
+		if (seen >= target) break;
+	}
+	return (lathigh(b) < h->max) ? lathigh(b) : h->max;
+}
+
+void commandLatency(unsigned long us) { record(&cmdlat, us); }
+
+void taskLatency(taskid slot, unsigned long us) {
+	locktasks();
+	task *t = &tasks[slot];			// the table may have been resized
+	if (!t->lat) t->lat = (histogram *) calloc(1, sizeof(histogram));
+	if (t->lat) record(t->lat, us);
+	unlocktasks();
+}
+
+void clearLatency(void) {
+	int slot;
+	memset(&cmdlat, 0, sizeof(cmdlat));
+	locktasks();
+	for (slot = 0; slot < numtasks; slot++) {
+		if (tasks[slot].lat) memset(tasks[slot].lat, 0, sizeof(histogram));
+	}
+	unlocktasks();
+}
+
+// a task's function name, for the listing
+void taskname(task *t, char *name) {
+	byte len = 0;
+	if (t->script.name[0] || (t->script.type != SCRIPT_EEPROM)) strcpy(name, t->script.name);
+	else {
+		while ((len < IDLEN) && eeread(t->macroid + len)) { name[len] = eeread(t->macroid + len); len++; }
+		name[len] = 0;
+	}
+}
+
+void showhistogram(histogram *h) {
+	printInteger(h->count, 9, ' ');
+	printInteger(percentile(h, 5000), 9, ' ');
+	printInteger(percentile(h, 9900), 9, ' ');
+	printInteger(percentile(h, 9990), 9, ' ');
+	printInteger(h->max, 9, ' ');
+	sp("  ");
+}
+
+//	lat: for the commands and each task that has run, how many runs and
+//	the us they took at the 50th, 99th and 99.9th percentiles, and at worst
+//
+void showLatency(void) {
+	char name[IDLEN+1];
+	int slot;
+	sp("     runs   p50 us   p99 us  p999 us   max us  what"); speol();
+	showhistogram(&cmdlat); sp("commands"); speol();
+	for (slot = 0; slot < numtasks; slot++) {
+		task *t = &tasks[slot];
+		if ((t->macroid == SLOT_FREE) || !t->lat || !t->lat->count) continue;
+		showhistogram(t->lat);
+		printInteger(slot, 0, ' '); sp(": ");
+		taskname(t, name);
+		sp(name);
+		speol();
+	}
+}
+
+//	lat("file"): write the histograms to file, a line for each bucket
+//	with anything in it, tab separated: what, from us, to us, count
+//	Returns false if the file can't be written
+//
+#if defined(UNIX_BUILD)
+void exporthistogram(FILE *f, const char *what, histogram *h) {
+	int b;
+	for (b = 0; b < LATBUCKETS; b++) {
+		if (h->buckets[b]) fprintf(f, "%s\t%lu\t%lu\t%lu\n", what, latlow(b), lathigh(b), h->buckets[b]);
+	}
+}
+#endif
+
+byte exportLatency(char *filename) {
+#if defined(UNIX_BUILD)
+	char name[IDLEN+1], what[IDLEN+16];
+	int slot;
+	FILE *f = fopen(filename, "w");
+	if (!f) return 0;
+	fprintf(f, "# what\tfrom us\tto us\tcount\n");
+	exporthistogram(f, "commands", &cmdlat);
+	for (slot = 0; slot < numtasks; slot++) {
+		task *t = &tasks[slot];
+		if ((t->macroid == SLOT_FREE) || !t->lat) continue;
+		taskname(t, name);
+		snprintf(what, sizeof(what), "%d:%s", slot, name);
+		exporthistogram(f, what, t->lat);
+	}
+	fclose(f);
+	return 1;
+#else
+	return 0;
+#endif
+}
+#endif	// TASK_LATENCY
+
+
+//////////
+//
+//	claimTask
+//
+//	Takes the task to run next off the run queue and marks it busy:
+//	the one due soonest, or if several are due, the one the ready heap picks
+//	Returns its slot, or -1 if no task is ready to run
+//
+int claimTask(void) {
+	locktasks();
+	unsigned long now = millis();
+	if (armed >= 0) checktriggers(now);
+	int slot = queuepop(now);
+	if (readysize || ((slot >= 0) && (queuewait(now) <= 0))) {
+		while (slot >= 0) {
+			readyinsert(slot);
+			slot = queuepop(now);
+		}
+		slot = readypop();
+	}
+	if (slot >= 0) tasks[slot].busy = 1;
+	unlocktasks();
+	return slot;
+}
+
+//////////
+//
+//	runTask
+//
+//	Runs a claimed task once and schedules its next run
+//
+void runTask(taskid slot) {
+	locktasks();
+	task *t = &tasks[slot];
+	int macroid = t->macroid;
+	scriptref script = t->script;
+#ifdef TASK_COROUTINES
+	if (!t->co)						// a resumed run was counted when it started
+#endif
+	{
+		signed long late = millis() - t->waketime;
+		if (late < 0) late = 0;
+		t->runs++;
+		t->latesum += late;
+		if (late > t->latemax) t->latemax = late;
+	}
+	unlocktasks();
+
+	if (macroid != SLOT_FREE) {		// it may have been stopped since it was claimed
+		byte suspended = 0;
+#ifdef TASK_LATENCY
+		unsigned long start = micros();
+#endif
+#ifdef TASK_COROUTINES
+		if (t->yields || t->co) suspended = resumeTask(slot, &script);
+		else
+#endif
+		{
+			startbudget(t);
+			runscript(slot, &script);
+		}
+#ifdef TASK_LATENCY
+		taskLatency(slot, micros() - start);
+#endif
+		if (suspended) return;		// it is back in the run queue
+	}
+
+	// schedule the next time quantum for this task
+	locktasks();
+	t = &tasks[slot];				// the table may have been resized
+	t->busy = 0;
+	if (t->macroid == SLOT_FREE) freeslot(slot);
+	else if (t->trigger) arm(slot);
+	else {
+		if ((t->snoozetime > 0) && ((signed long) (millis() - deadline(t)) > 0)) t->overdue++;
+		reschedule(t);
+		queueinsert(slot);
+	}
+	unlocktasks();
+}
+
+unsigned long millisUntilNextTask(void) {
+	long millis_to_wait = nextTaskDue();
+	if ((millis_to_wait < 0) || (millis_to_wait > 500L)) millis_to_wait = 500L;
+	return millis_to_wait;			// millis until next task runs
+}
+
+//////////
+//
+//	nextTaskDue
+//
+//	Returns the millis until the next task is due, as exactly as the run
+//	queue knows it, or -1 if no task is waiting on the clock
+//	The virtual clock in bitlash-unix.c jumps ahead by this much
+//
+long nextTaskDue(void) {
+	locktasks();
+	long millis_to_wait = -1;
+	if (readysize) millis_to_wait = 0;
+	else if (!queueempty()) {
+		millis_to_wait = queuewait(millis());
+		if (millis_to_wait < 0) millis_to_wait = 0;
+	}
+#ifdef TRIGPOLL
+	if (pintasks && ((millis_to_wait < 0) || (millis_to_wait > TRIGPOLL))) millis_to_wait = TRIGPOLL;
+#endif
+	unlocktasks();
+	return millis_to_wait;
+}
+
+#ifdef TASK_WORKERS
+//////////
+//
+//	waitForTask
+//
+//	Sleeps until the next task is due, at most 500 ms,
+//	or until a task is started or stopped
+//
+void waitForTask(void) {
+	struct timespec deadline;
+	locktasks();
+	long millis_to_wait = readysize ? 0 : queuewait(millis());
+#ifdef TRIGPOLL
+	if (pintasks && (millis_to_wait > TRIGPOLL)) millis_to_wait = TRIGPOLL;
+#endif
+	if (millis_to_wait > 0) {
+		if (millis_to_wait > 500L) millis_to_wait = 500L;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += millis_to_wait / 1000;
+		deadline.tv_nsec += (millis_to_wait % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&taskwake, &tasklock, &deadline);
+	}
+	unlocktasks();
+}
+#endif
+
+//////////
+//
+//	showTaskList
+//
+//	Lists a page of tasks starting at slot first, with a pointer to the next page
+//
+//	0: tick every 1000 skip prio 2 budget 50,2000 runs 12 late 0/3 missed 1 overdue 1 overruns 2
+//
+//	late is the average and the worst ms the task started after its wake time
+//	overdue is the number of runs that missed their deadline, the next period
+//	overruns is the number of times it ran over its budget
+//
+#define PSPAGE 20
+
+// as it was given to run: on d3 rising
+void showtrigger(task *t) {
+	sp(" on ");
+	if (t->trigger == TRIG_INPUT) { sp("input"); return; }
+	if (t->trigger == TRIG_VAR) { spb('a' + t->trigpin); return; }
+	spb(((t->trigger == TRIG_ABOVE) || (t->trigger == TRIG_BELOW)) ? 'a' : 'd');
+	printInteger(t->trigpin, 0, ' ');
+	if (t->trigger == TRIG_RISING) sp(" rising");
+	else if (t->trigger == TRIG_FALLING) sp(" falling");
+	else if (t->trigger == TRIG_ABOVE) { sp(" above "); printInteger(t->threshold, 0, ' '); }
+	else if (t->trigger == TRIG_BELOW) { sp(" below "); printInteger(t->threshold, 0, ' '); }
+}
+void showTaskList(taskid first) {
+int slot, shown = 0;
+task row;							// a copy, so printing holds no lock
+	if (first < 0) first = 0;
+	for (slot = first; ; slot++) {
+		locktasks();
+		byte inrange = slot < numtasks;
+		if (inrange) row = tasks[slot];
+		unlocktasks();
+		if (!inrange) break;
+		task *t = &row;
+		if (t->macroid != SLOT_FREE) {
+			if (shown++ == PSPAGE) {
+				sp("more: ps "); printInteger(slot, 0, ' '); speol();
+				break;
+			}
+			printInteger(slot, 0, ' '); spb(':'); spb(' ');
+			if (t->script.type == SCRIPT_EEPROM) eeputs(t->macroid);
+			else sp(t->script.name);
+			if (t->trigger) showtrigger(t);
+			else if (t->snoozetime) { sp(" every "); printInteger(t->snoozetime, 0, ' '); }
+			if (t->rate == RATE_BURST) sp(" burst");
+			else if (t->rate == RATE_SKIP) sp(" skip");
+			else if (t->rate == RATE_COALESCE) sp(" coalesce");
+			if (t->prio) { sp(" prio "); printInteger(t->prio, 0, ' '); }
+			if (t->maxsteps || t->maxus) {
+				sp(" budget "); printInteger(t->maxsteps, 0, ' ');
+				if (t->maxus) { spb(','); printInteger(t->maxus, 0, ' '); }
+			}
+			sp(" runs "); printInteger(t->runs, 0, ' ');
+			sp(" late "); printInteger(t->runs ? t->latesum / t->runs : 0, 0, ' ');
+			spb('/'); printInteger(t->latemax, 0, ' ');
+			if (t->rate != RATE_DELAY) { sp(" missed "); printInteger(t->missed, 0, ' '); }
+			if (t->overdue) { sp(" overdue "); printInteger(t->overdue, 0, ' '); }
+			if (t->overruns) { sp(" overruns "); printInteger(t->overruns, 0, ' '); }
+#ifdef TASK_COROUTINES
+			if (t->co && !t->busy) sp(t->co->keywait ? " waiting" : " suspended");
+#endif
+			speol();
+		}
+	}
+}
+
+
+#else	// fixed task table
 
 // BUG: this fails for eeproms > 64k in size
 int tasklist[NUMTASKS];				// EEPROM address of text of the function
 numvar snoozetime[NUMTASKS];		// time between task invocations
 unsigned long waketime[NUMTASKS];	// millis() time this task is eligible to run
 
-#define SLOT_FREE -1
+byte nexttask;						// round robin position
 
 void initTaskList(void) { 
 	memset(tasklist, 0xff, NUMTASKS * sizeof(tasklist[0]));
@@ -56,10 +1495,13 @@ void initTaskList(void) {
 	//for (byte slot = 0; (slot < NUMTASKS); slot++) tasklist[slot] = SLOT_FREE;
 }
 
-void stopTask(byte slot) { if (slot < NUMTASKS) tasklist[slot] = SLOT_FREE; }
+void stopTask(taskid slot) {
+	if (slot < NUMTASKS) tasklist[slot] = SLOT_FREE;
+	saveTasks();
+}
 
-// add task to run list
-void startTask(int macroid, numvar snoozems) {
+// add task to run list; returns its slot
+taskid startTask(int macroid, numvar snoozems) {
 byte slot;
 	for (slot = 0; (slot < NUMTASKS); slot++) {
 		if (tasklist[slot] == SLOT_FREE) {
@@ -69,49 +1511,55 @@ byte slot;
 			// eligible to run at the end of 1 tick
 			waketime[slot] = millis() + snoozems;
 //			waketime[slot] = millis();		// eligible to run now
-			return;
+			saveTasks();
+			return slot;
 		}
 	}
 	overflow(M_id);
+	return 0;
 }
 
 
 void snooze(unumvar duration) {
-	if (background) snoozetime[curtask] = duration;
+	if (CTX(background)) snoozetime[CTX(curtask)] = duration;
 	else delay(duration);
 }
 
 
 //////////
 //
-//	runBackgroundTasks
+//	claimTask
 //
-//	Runs one eligible background task per invocation
-//	Returns true if a task was run
+//	Finds the next eligible task on a round robin basis
+//	Returns its slot, or -1 if no task is ready to run
 //
-void runBackgroundTasks(void) {
-byte i;	
-
-#ifdef suspendBackground
-	if (suspendBackground) return;
-#endif
-
+int claimTask(void) {
+byte i;
 	for (i=0; i<NUMTASKS; i++) {
-		// run one task per call on a round robin basis
-		if (++curtask >= NUMTASKS) curtask = 0;
-		if ((tasklist[curtask] != SLOT_FREE) && 
-			(((signed long) millis() - (signed long) waketime[curtask])) >= 0) {
-
-			// run it with the background flag set
-			background = 1;
-			execscript(SCRIPT_EEPROM, findend(tasklist[curtask]), 0);
-
-			// schedule the next time quantum for this task
-			waketime[curtask] = millis() + snoozetime[curtask];
-			background = 0;
-			break;
+		if (++nexttask >= NUMTASKS) nexttask = 0;
+		if ((tasklist[nexttask] != SLOT_FREE) &&
+			(((signed long) millis() - (signed long) waketime[nexttask])) >= 0) {
+			return nexttask;
 		}
 	}
+	return -1;
+}
+
+//////////
+//
+//	runTask
+//
+//	Runs a claimed task once and schedules its next run
+//
+void runTask(taskid slot) {
+	// run it with the background flag set
+	CTX(background) = 1;
+	CTX(curtask) = slot;
+	execscript(SCRIPT_EEPROM, findend(tasklist[slot]), 0);
+
+	// schedule the next time quantum for this task
+	waketime[slot] = millis() + snoozetime[slot];
+	CTX(background) = 0;
 }
 
 unsigned long millisUntilNextTask(void) {
@@ -127,14 +1575,204 @@ byte slot;
 	return millis_to_wait;			// millis until next task runs
 }
 
-void showTaskList(void) {
+void showTaskList(taskid first) {
 byte slot;
-	for (slot = 0; slot < NUMTASKS; slot++) {
+	for (slot = first; slot < NUMTASKS; slot++) {
 		if (tasklist[slot] != SLOT_FREE) {
 			printInteger(slot, 0, ' '); spb(':'); spb(' ');
 			eeputs(tasklist[slot]); speol();
 		}
 	}
 }
+#endif	// TASK_TABLE
 
 
+#if defined(TASK_PERSIST)
+//////////
+//
+//	Persisted task list
+//
+//	The running tasks are kept in the EEPROM from TASKDB to ENDEEPROM,
+//	rewritten by saveTasks() whenever the set changes and started again
+//	by restoreTasks() at reset, so a node is back at work after a table
+//	read instead of a startup script full of run commands.
+//
+//	The list is TASKDB_MAGIC then an entry per task: the script type, the
+//	snooze time in 4 bytes, and on the task table builds the priority in
+//	2 bytes, the rate policy and the trigger, and for a trigger its pin in 
+//	1 byte and threshold in 4.  Then for an EEPROM function its address in
+//	2 bytes, and the script's name.  EMPTY ends it.
+//	Budgets are not kept, nor are tasks past the ones that fit.
+//
+#define TASKDB_MAGIC 'V'			// 'T' lists had no rate or trigger, 'U' no EEPROM names
+
+byte taskdbready;				// saves are held off until the list is restored
+int taskdbaddr;					// where the next byte goes
+
+// write len bytes of value, low byte first, leaving room for the EMPTY at the end
+// returns false if they don't fit
+byte dbput(unsigned long value, byte len) {
+	while (len--) {
+		if (taskdbaddr >= ENDEEPROM) return 0;
+		if (eeread(taskdbaddr) != (byte) value) eewrite(taskdbaddr, value);	// spare the EEPROM
+		taskdbaddr++;
+		value >>= 8;
+	}
+	return 1;
+}
+
+unsigned long dbget(byte len) {
+	unsigned long value = 0;
+	byte shift = 0;
+	while (len--) {
+		value |= (unsigned long) eeread(taskdbaddr++) << shift;
+		shift += 8;
+	}
+	return value;
+}
+
+// add an entry; returns false if it doesn't fit
+#if defined(TASK_TABLE)
+byte dbsave(task *t) {
+	byte type = t->script.type;
+	numvar macroid = t->script.addr;
+	char *name = t->script.name;
+	int start = taskdbaddr;
+	byte ok = dbput(type, 1) && dbput(t->snoozetime, 4) && dbput(t->prio, 2) &&
+		dbput(t->rate, 1) && dbput(t->trigger, 1);
+	if (t->trigger) ok = ok && dbput(t->trigpin, 1) && dbput(t->threshold, 4);
+#else
+byte dbsave(numvar macroid, numvar snoozems) {
+	byte type = SCRIPT_EEPROM;
+	char *name = 0;
+	int start = taskdbaddr;
+	byte ok = dbput(type, 1) && dbput(snoozems, 4);
+#endif
+	if (type == SCRIPT_EEPROM) {
+		ok = ok && dbput(macroid, 2);
+		// and its name, so a function since put in its place isn't taken for it
+		byte c;
+		do { c = eeread(macroid++); ok = ok && dbput(c, 1); } while (c);
+	}
+	else {
+		do { ok = ok && dbput(*name, 1); } while (*name++);
+	}
+	if (!ok) taskdbaddr = start;
+	return ok;
+}
+
+//////////
+//
+//	saveTasks
+//
+//	Writes the list of running tasks to the EEPROM
+//
+void saveTasks(void) {
+	if (!taskdbready) return;
+	taskdbaddr = TASKDB;
+	dbput(TASKDB_MAGIC, 1);
+	int slot;
+#if defined(TASK_TABLE)
+	locktasks();
+	for (slot = 0; slot < numtasks; slot++) {
+		if (tasks[slot].macroid == SLOT_FREE) continue;
+		if (!dbsave(&tasks[slot])) break;
+	}
+	unlocktasks();
+#else
+	for (slot = 0; slot < NUMTASKS; slot++) {
+		if (tasklist[slot] == SLOT_FREE) continue;
+		if (!dbsave(tasklist[slot], snoozetime[slot])) break;
+	}
+#endif
+	if (eeread(taskdbaddr) != EMPTY) eewrite(taskdbaddr, EMPTY);
+}
+
+//////////
+//
+//	restoreTasks
+//
+//	Starts the tasks in the persisted list again, once.  runBitlash() calls
+//	it the first time through, after setup() has added its C functions; a
+//	host that doesn't call runBitlash() calls it after adding them.
+//	Entries whose function is gone are dropped.
+//
+void restoreTasks(void) {
+	if (taskdbready) return;
+	taskdbaddr = TASKDB;
+	if (eeread(taskdbaddr++) == TASKDB_MAGIC) {
+		for (;;) {
+			byte type = eeread(taskdbaddr++);
+			if (type == EMPTY) break;
+			numvar snoozems = dbget(4);
+#if defined(TASK_TABLE)
+			int prio = (int) (short) dbget(2);
+			byte rate = dbget(1);
+			byte trigger = dbget(1), pin = 0;
+			numvar threshold = 0;
+			if (trigger) {
+				pin = dbget(1);
+				threshold = dbget(4);
+			}
+#endif
+			numvar macroid = 0;
+			char name[IDLEN+1];
+			name[0] = 0;
+			if (type == SCRIPT_EEPROM) macroid = dbget(2);
+			byte len = 0;
+			char c;
+			while ((c = eeread(taskdbaddr++)) != 0) if (len < IDLEN) name[len++] = c;
+			name[len] = 0;
+
+			// an EEPROM function must still start where it did, under the
+			// same name: not erased, nor another one saved into its hole
+			if (type == SCRIPT_EEPROM) {
+				if ((macroid < STARTDB) || (macroid >= ENDDB) || (eeread(macroid) == EMPTY)) continue;
+				if ((macroid > STARTDB) && (eeread(macroid - 1) != 0) && (eeread(macroid - 1) != EMPTY)) continue;
+				if (!eestrmatch(macroid, name)) continue;
+			}
+#if defined(TASK_TABLE)
+			// other scripts move about, so find them by name as run would
+			else {
+				strcpy(CTX(idbuf), name);
+				resolveid();
+				if (type == SCRIPT_FILE) { if (CTX(sym) != s_script_file) continue; }
+				else if (type == SCRIPT_PROGMEM) { if (CTX(sym) != s_script_progmem) continue; }
+				else if ((type != SCRIPT_FUNCTION) || (CTX(sym) != s_nfunct)) continue;
+				macroid = CTX(symval);
+			}
+			if (freetask < 0) break;		// the table is smaller than it was
+			taskid slot = startScriptTask(type, macroid, name, snoozems);
+			if (prio) setTaskPriority(slot, prio);
+			if (rate) setTaskRate(slot, rate);
+			if (trigger) setTaskTrigger(slot, trigger, pin, threshold);
+#else
+			else continue;
+			byte slot;
+			for (slot = 0; (slot < NUMTASKS) && (tasklist[slot] != SLOT_FREE); slot++) {;}
+			if (slot >= NUMTASKS) break;
+			startTask(macroid, snoozems);
+#endif
+		}
+	}
+	taskdbready = 1;
+	saveTasks();			// drop what didn't come back
+}
+#endif	// TASK_PERSIST
+
+
+//////////
+//
+//	runBackgroundTasks
+//
+//	Runs one eligible background task per invocation
+//
+void runBackgroundTasks(void) {
+
+#ifdef suspendBackground
+	if (suspendBackground) return;
+#endif
+
+	int slot = claimTask();
+	if (slot >= 0) runTask(slot);
+}
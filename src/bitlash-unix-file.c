@@ -80,14 +80,7 @@
 
 #if defined(UNIX_BUILD)
 
-FILE *scriptfile;
-byte scriptfile_is_open;
-
-
-// filename buffer for 8.3 + \0
-#define FNAMELEN 13
-char cachedname[FNAMELEN];
-byte cachedflags;
+// the open script file is per context; see bitlash.h
 
 // return true iff script exists
 byte scriptfileexists(char *scriptname) {
@@ -98,10 +91,10 @@ byte scriptfileexists(char *scriptname) {
 }
 
 byte scriptclose(void) {
-	if (scriptfile_is_open) fclose(scriptfile);
-	scriptfile_is_open = 0;
-    scriptfile = 0;
-    *cachedname = 0;
+	if (CTX(scriptfile_is_open)) fclose(CTX(scriptfile));
+	CTX(scriptfile_is_open) = 0;
+    CTX(scriptfile) = 0;
+    *CTX(cachedname) = 0;
 	return 0;
 }
 
@@ -110,17 +103,17 @@ byte scriptopen(char *scriptname, numvar position, byte flags) {
 
 	// open the input file if there is no file open, 
 	// or the open file does not match what we want
-	if (!scriptfile_is_open || strcmp(scriptname, cachedname) || (flags != cachedflags)) {
-		if (scriptfile_is_open) scriptclose();
-		scriptfile = fopen(scriptname, "r");
-		if (!scriptfile) return 0;
-		strcpy(cachedname, scriptname);		// cache the name we have open
-		cachedflags = flags;				// and the mode
-		scriptfile_is_open = 1;				// note it's open
+	if (!CTX(scriptfile_is_open) || strcmp(scriptname, CTX(cachedname)) || (flags != CTX(cachedflags))) {
+		if (CTX(scriptfile_is_open)) scriptclose();
+		CTX(scriptfile) = fopen(scriptname, "r");
+		if (!CTX(scriptfile)) return 0;
+		strcpy(CTX(cachedname), scriptname);		// cache the name we have open
+		CTX(cachedflags) = flags;				// and the mode
+		CTX(scriptfile_is_open) = 1;				// note it's open
 		if (position == 0L) return 1;		// save a seek, when we can
 	}
 	extern off_t lseek(int fd, off_t offset, int whence);
-	off_t seek_status = fseek(scriptfile, (off_t) position, SEEK_SET);
+	off_t seek_status = fseek(CTX(scriptfile), (off_t) position, SEEK_SET);
     int err = errno;
     if (seek_status == -1) return 0;
 	return 1;
@@ -128,12 +121,12 @@ byte scriptopen(char *scriptname, numvar position, byte flags) {
 
 
 numvar scriptgetpos(void) {
-	return ftell(scriptfile);
+	return ftell(CTX(scriptfile));
 }
 
 byte scriptread(void) {
 	byte input;
-	if (!fread(&input, 1, 1, scriptfile)) {
+	if (!fread(&input, 1, 1, CTX(scriptfile))) {
 		scriptclose();
 		return 0;		// eof
 	}
@@ -151,12 +144,12 @@ byte scriptwrite(char *filename, char *contents, byte append) {
 	if (append) flags = "a";
 	else flags = "w";
 
-	if (scriptfile_is_open) scriptclose();
-	scriptfile = fopen(filename, flags);
-	if (!scriptfile) return 0;
-	strcpy(cachedname, filename);		// cache the name we have open
-	cachedflags = 1;					// and the mode
-	scriptfile_is_open = 1;				// note it's open
+	if (CTX(scriptfile_is_open)) scriptclose();
+	CTX(scriptfile) = fopen(filename, flags);
+	if (!CTX(scriptfile)) return 0;
+	strcpy(CTX(cachedname), filename);		// cache the name we have open
+	CTX(cachedflags) = 1;					// and the mode
+	CTX(scriptfile_is_open) = 1;				// note it's open
 	
     if (strlen(contents)) {
 		if (fwrite(contents, 1, strlen(contents), outfile) != strlen(contents)) {
@@ -170,7 +163,7 @@ byte scriptwrite(char *filename, char *contents, byte append) {
 
 void scriptwritebyte(byte b) {
 	// TODO: error check here
-	fwrite(&b, 1, 1, scriptfile);
+	fwrite(&b, 1, 1, CTX(scriptfile));
 }
 
 
@@ -182,6 +175,7 @@ numvar sdexists(void) {
 	return scriptfileexists((char *) getarg(1)); 
 }
 numvar sdrm(void) { 
+	newdefinition();
 	return unlink((char *) getarg(1)); 
 }
 numvar sdcreate(void) { 
@@ -192,7 +186,8 @@ numvar sdappend(void) {
 }
 numvar sdcd(void) {
 	// close any cached open file handle
-	if (scriptfile_is_open) scriptclose();
+	if (CTX(scriptfile_is_open)) scriptclose();
+	newdefinition();
 	return chdir((char *) getarg(1));
 }
 numvar sdmd(void) { 
@@ -0,0 +1,267 @@
+/***
+	bitlash-unix-prof.c: sampling profiler for Bitlash scripts
+
+	Bitlash is a tiny language interpreter that provides a serial port shell environment
+	for bit banging and hardware hacking.
+
+	Bitlash lives at: http://bitlash.net
+	The author can be reached at: bill@bitlash.net
+
+	Copyright (C) 2008-2012 Bill Roy
+
+	Permission is hereby granted, free of charge, to any person
+	obtaining a copy of this software and associated documentation
+	files (the "Software"), to deal in the Software without
+	restriction, including without limitation the rights to use,
+	copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following
+	conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+	HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+	WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+	OTHER DEALINGS IN THE SOFTWARE.
+
+***/
+#include "bitlash.h"
+
+#if defined(UNIX_BUILD)
+#include <signal.h>
+#include <sys/time.h>
+
+//////////
+//
+//	Script profiler
+//
+//	prof on starts a SIGPROF timer which, every millisecond of CPU time,
+//	notes where the interpreter is: the script type and position it is
+//	reading, whether a task is running, and the script functions on the
+//	arg frame chain, as traceback() walks them.  Identical samples are
+//	counted in a fixed table, so the handler allocates nothing, and prof
+//	can stay on as long as you like.
+//
+//	prof dump maps each position to its function and line, prints a flat
+//	profile by line, and writes the stacks to prof.folded in the folded
+//	format flamegraph.pl reads.
+//
+#define PROFUS 1000				// sample interval, us of CPU time
+#define PROFSLOTS 4096			// distinct places counted; a power of 2
+#define PROFDEPTH 16			// script frames kept, innermost first
+
+typedef struct {
+	unsigned long count;
+	numvar ptr;					// fetchptr
+	byte type;					// fetchtype
+	byte bg;					// in a background task
+	byte depth;
+	char *frames[PROFDEPTH];	// interned function names
+} profslot;
+
+profslot *proftable;
+unsigned long profsamples, proflost;
+volatile sig_atomic_t profbusy;	// a sample or a dump holds the table
+byte profiling;
+
+void profsample(int signo) {
+	if (!proftable || __sync_lock_test_and_set(&profbusy, 1)) {
+		proflost++;
+		return;
+	}
+	profslot s;
+	s.ptr = CTX(fetchptr);
+	s.type = CTX(fetchtype);
+	s.bg = CTX(background);
+	s.depth = 0;
+	numvar *a = CTX(arg);
+	while (a && (s.depth < PROFDEPTH)) {
+		if (argname(a)) s.frames[s.depth++] = argname(a);
+		a = argparent(a);
+	}
+
+	unsigned long hash = (s.ptr * 31) + (s.type << 4) + s.bg;
+	byte i;
+	for (i = 0; i < s.depth; i++) hash = (hash * 31) + (unsigned long) s.frames[i];
+	hash ^= hash >> 13;
+
+	int probe;
+	for (probe = 0; probe < PROFSLOTS; probe++) {
+		profslot *p = &proftable[(hash + probe) & (PROFSLOTS - 1)];
+		if (!p->count) {
+			*p = s;
+			p->count = 1;
+			break;
+		}
+		if ((p->ptr == s.ptr) && (p->type == s.type) && (p->bg == s.bg) && (p->depth == s.depth) &&
+			!memcmp(p->frames, s.frames, s.depth * sizeof(s.frames[0]))) {
+			p->count++;
+			break;
+		}
+	}
+	if (probe < PROFSLOTS) profsamples++;
+	else proflost++;
+	__sync_lock_release(&profbusy);
+}
+
+void settimer(long us) {
+	struct itimerval when;
+	when.it_interval.tv_sec = when.it_value.tv_sec = 0;
+	when.it_interval.tv_usec = when.it_value.tv_usec = us;
+	setitimer(ITIMER_PROF, &when, NULL);
+}
+
+// prof on: start over and sample until prof off
+void startProfiler(void) {
+	if (!proftable) {
+		proftable = (profslot *) calloc(PROFSLOTS, sizeof(profslot));
+		if (!proftable) overflow(M_oops);
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = profsample;
+		sa.sa_flags = SA_RESTART;
+		sigaction(SIGPROF, &sa, NULL);
+	}
+	else memset(proftable, 0, PROFSLOTS * sizeof(profslot));
+	profsamples = proflost = 0;
+	profiling = 1;
+	settimer(PROFUS);
+}
+
+void stopProfiler(void) {
+	settimer(0);
+	profiling = 0;
+}
+
+
+// where a sample was: the function it was in, and the line within it
+typedef struct {
+	char name[IDLEN+1];
+	int line;
+	unsigned long count;
+} profline;
+
+// count the lines up to offset in a script file
+int fileline(char *name, numvar offset) {
+	FILE *f = fopen(name, "r");
+	if (!f) return 0;
+	int line = 1, c = 0;
+	while ((offset-- > 0) && ((c = fgetc(f)) != EOF)) if (c == '\n') line++;
+	if ((c == '\n') && (fgetc(f) == EOF)) line--;		// at the end, not on a line past it
+	fclose(f);
+	return line;
+}
+
+void locate(profslot *s, profline *where) {
+	where->name[0] = 0;
+	where->line = 0;
+	if (s->type == SCRIPT_EEPROM) {
+		// find the function whose text holds ptr
+		int start = STARTDB;
+		while ((start = findoccupied(start)) != FAIL) {
+			int text = findend(start);
+			int end = findend(text);
+			if ((s->ptr >= text) && (s->ptr < end)) {
+				byte len = 0;
+				while ((len < IDLEN) && eeread(start + len)) { where->name[len] = eeread(start + len); len++; }
+				where->name[len] = 0;
+				where->line = 1;
+				for (; text < s->ptr; text++) if (eeread(text) == '\n') where->line++;
+				return;
+			}
+			start = end;
+		}
+	}
+	else if (s->type == SCRIPT_PROGMEM) {
+		extern const prog_char builtin_table[];
+		const prog_char *entry = builtin_table;
+		while (pgm_read_byte(entry)) {
+			const prog_char *text = entry + strlen_P(entry) + 1;
+			const prog_char *end = text + strlen_P(text) + 1;
+			if ((s->ptr >= (numvar) text) && (s->ptr < (numvar) end)) {
+				strncpy(where->name, entry, IDLEN);
+				where->name[IDLEN] = 0;
+				where->line = 1;
+				for (; (numvar) text < s->ptr; text++) if (pgm_read_byte(text) == '\n') where->line++;
+				return;
+			}
+			entry = end;
+		}
+	}
+	else if ((s->type == SCRIPT_FILE) && s->depth) {
+		// a file script always runs in a frame of its own name
+		strcpy(where->name, s->frames[0]);
+		where->line = fileline(where->name, s->ptr);
+		return;
+	}
+	strcpy(where->name, (s->type == SCRIPT_RAM) ? "(command)" : "(no script)");
+}
+
+int bycount(const void *a, const void *b) {
+	unsigned long ca = ((profline *) a)->count, cb = ((profline *) b)->count;
+	return (ca < cb) - (ca > cb);
+}
+
+// prof dump: print the flat profile, and write prof.folded
+void dumpProfile(void) {
+	if (!proftable) return;
+	profbusy = 1;				// samples meanwhile are lost, not half-counted
+
+	profline *lines = (profline *) malloc(PROFSLOTS * sizeof(profline));
+	FILE *folded = fopen("prof.folded", "w");
+	int nlines = 0, i, j;
+	unsigned long total = 0;
+	for (i = 0; i < PROFSLOTS; i++) {
+		profslot *s = &proftable[i];
+		if (!s->count) continue;
+		profline where;
+		locate(s, &where);
+		where.count = s->count;
+		total += s->count;
+
+		// add it to its line
+		if (lines) {
+			for (j = 0; j < nlines; j++) {
+				if ((lines[j].line == where.line) && !strcmp(lines[j].name, where.name)) break;
+			}
+			if (j < nlines) lines[j].count += where.count;
+			else lines[nlines++] = where;
+		}
+
+		// and write its stack, outermost first, with the line on the last frame
+		if (folded) {
+			fprintf(folded, "%s", s->bg ? "task" : "command");
+			int d, innermost = (s->depth && !strcmp(s->frames[0], where.name));	// named below
+			for (d = s->depth - 1; d >= innermost; d--) fprintf(folded, ";%s", s->frames[d]);
+			if (where.line) fprintf(folded, ";%s:%d %lu\n", where.name, where.line, s->count);
+			else fprintf(folded, ";%s %lu\n", where.name, s->count);
+		}
+	}
+	if (folded) fclose(folded);
+
+	printInteger(total, 0, ' '); sp(" samples");
+	if (proflost) { sp(", "); printInteger(proflost, 0, ' '); sp(" lost"); }
+	if (folded) sp("; stacks in prof.folded");
+	speol();
+	if (lines) {
+		qsort(lines, nlines, sizeof(profline), bycount);
+		sp("  samples    %  where"); speol();
+		for (j = 0; j < nlines; j++) {
+			printInteger(lines[j].count, 9, ' '); spb(' ');
+			printInteger((lines[j].count * 100) / total, 4, ' '); sp("  ");
+			sp(lines[j].name);
+			if (lines[j].line) { spb(':'); printInteger(lines[j].line, 0, ' '); }
+			speol();
+		}
+		free(lines);
+	}
+	profbusy = 0;
+}
+
+#endif	// UNIX_BUILD
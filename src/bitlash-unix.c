@@ -26,6 +26,12 @@
 	FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 	OTHER DEALINGS IN THE SOFTWARE.
 */
+#if defined(__linux__)
+// these must come first: bitlash.h defines uint8_t and friends as macros
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#endif
 #include "bitlash.h"
 
 /*
@@ -66,6 +72,17 @@ char bitlash_directory[PATH_LEN];
 #define DEFAULT_BITLASH_PATH "/.bitlash/"
 
 
+// virtual clock
+// With BITLASH_VIRTUAL set in the environment, millis() and micros() read
+// a simulated clock instead.  It stands still while scripts run; delay()
+// just moves it on, and when there is nothing else to do the event loop 
+// jumps it straight to the next task's wake time.  A long schedule then 
+// runs as fast as its tasks can, with the same results every time.
+// After the input ends it goes on until the clock reads BITLASH_VIRTUAL ms.
+byte virtualtime;
+unsigned long long virtualus;		// the time in microseconds
+unsigned long horizon;				// where to stop after the input ends
+
 #if _POSIX_TIMERS	// not on the Mac, unfortunately
 struct timespec startup_time, current_time, elapsed_time;
 
@@ -87,10 +104,19 @@ void init_millis(void) {
 }
 
 unsigned long millis(void) {
+	if (virtualtime) return virtualus / 1000;
 	clock_gettime(CLOCK_REALTIME, &current_time);	
 	elapsed_time = time_diff(startup_time, current_time);
 	return (elapsed_time.tv_sec * 1000UL) + (elapsed_time.tv_nsec / 1000000UL);
 }
+
+unsigned long micros(void) {
+	if (virtualtime) return virtualus;
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	struct timespec elapsed = time_diff(startup_time, now);
+	return (elapsed.tv_sec * 1000000UL) + (elapsed.tv_nsec / 1000UL);
+}
 #else
 #include <sys/time.h>
 
@@ -104,12 +130,20 @@ void init_millis(void) {
 }
 
 unsigned long millis(void) {
+	if (virtualtime) return virtualus / 1000;
 	gettimeofday(&current_time, NULL);
 	current_millis = (current_time.tv_sec * 1000) + (current_time.tv_usec / 1000);
 	elapsed_millis = current_millis - startup_millis;
 	return elapsed_millis;
 }
 
+unsigned long micros(void) {
+	if (virtualtime) return virtualus;
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return ((now.tv_sec - startup_time.tv_sec) * 1000000UL) + (now.tv_usec - startup_time.tv_usec);
+}
+
 #endif
 
 
@@ -161,7 +195,13 @@ int serialRead(void) {
 }
 #endif
 
-#if 1
+#include <signal.h>
+#include <unistd.h>
+
+byte break_received;
+
+#if defined(TASK_WORKERS)
+// main() reads the command line a line at a time with fgets
 int serialAvailable(void) { 
 	return 0;
 }
@@ -170,6 +210,79 @@ int serialRead(void) {
 	return '$';
 }
 
+void pollinput(void) {;}
+
+#else
+// stdin is read into inbuf only when poll says it is ready, so a read
+// never blocks, and commands and scripts see it as the serial port
+#include <poll.h>
+#include <termios.h>
+#define INBUFLEN 1024
+char inbuf[INBUFLEN];
+int inhead, intail;
+byte input_eof;
+
+byte checksignals(void);
+
+void readinput(void) {
+	struct pollfd pfd = { 0, POLLIN, 0 };
+	if (input_eof) return;
+	if (inhead == intail) inhead = intail = 0;
+	else if (intail == INBUFLEN) {
+		if (inhead == 0) return;		// full
+		memmove(inbuf, inbuf + inhead, intail - inhead);
+		intail -= inhead;
+		inhead = 0;
+	}
+	if (poll(&pfd, 1, 0) <= 0) return;
+	int got = read(0, inbuf + intail, INBUFLEN - intail);
+	if (got > 0) intail += got;
+	else input_eof = 1;
+}
+
+int serialAvailable(void) { 
+	if (inhead == intail) readinput();
+	return intail - inhead;
+}
+
+int serialRead(void) {
+	if (!serialAvailable()) return -1;
+	return (byte) inbuf[inhead++];
+}
+
+// called from chkbreak while a command runs: pick up new input,
+// and break on ^C typed ahead or on SIGINT
+void pollinput(void) {
+	int scan = intail;
+	readinput();
+	while (scan < intail) {
+		if (inbuf[scan++] == 3) {
+			break_received = 1;
+			inhead = intail = 0;		// ^C discards typed-ahead input
+		}
+	}
+	if (checksignals()) break_received = 1;
+}
+
+// with a terminal, turn off line editing and echo: doCharacter does them
+struct termios saved_term;
+byte term_saved;
+
+void restoreterm(void) {
+	if (term_saved) tcsetattr(0, TCSANOW, &saved_term);
+}
+
+void initterm(void) {
+	if (tcgetattr(0, &saved_term) != 0) return;		// not a terminal
+	struct termios raw = saved_term;
+	raw.c_lflag &= ~(ICANON | ECHO);		// ISIG stays on: ^C is SIGINT
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	tcsetattr(0, TCSANOW, &raw);
+	term_saved = 1;
+	atexit(restoreterm);
+}
+
 #endif
 	
 void spb (char c) {
@@ -187,12 +300,15 @@ numvar setBaud(numvar pin, unumvar baud) { return 0; }
 
 // stubs for the hardware IO functions
 //
-unsigned long pins;
+unsigned long long pins;				// 64 pins, enough for a Mega
+#define PINBIT(pin) ((pin) < 64 ? (1ULL << (pin)) : 0)
 void pinMode(byte pin, byte mode) { ; }
-int digitalRead(byte pin) { return ((pins & (1<<pin)) != 0); }
+int digitalRead(byte pin) { return ((pins & PINBIT(pin)) != 0); }
 void digitalWrite(byte pin, byte value) {
-	if (value) pins |= 1<<pin;
-	else pins &= ~(1<<pin);
+	unsigned long long was = pins;
+	if (value) pins |= PINBIT(pin);
+	else pins &= ~PINBIT(pin);
+	if (pins != was) checkTriggers();		// see every edge, not just where it ends up
 }
 int analogRead(byte pin) { return 0; }
 void analogWrite(byte pin, int value) { ; }
@@ -203,6 +319,10 @@ int pulseIn(int pin, int mode, int duration) { return 0; }
 void delay(unsigned long ms) {
 //	unsigned long start = millis();
 //	while (millis() - start < ms) { ; }
+	if (virtualtime) {
+		virtualus += ms * 1000ULL;
+		return;
+	}
 	struct timespec delay_time;
 	long seconds = ms / 1000L;
 	delay_time.tv_sec = seconds;
@@ -211,6 +331,10 @@ void delay(unsigned long ms) {
 }
 
 void delayMicroseconds(unsigned int us) {
+	if (virtualtime) {
+		virtualus += us;
+		return;
+	}
 	struct timespec delay_time;
 	long seconds = us / 1000000L;
 	delay_time.tv_sec = seconds;
@@ -219,13 +343,42 @@ void delayMicroseconds(unsigned int us) {
 }
 
 // fake eeprom
-byte fake_eeprom[E2END];
+byte eeprom_ram[E2END+1];
+byte *fake_eeprom = eeprom_ram;
 byte eeread(int addr) { return fake_eeprom[addr]; }
 void eewrite(int addr, byte value) { fake_eeprom[addr] = value; }
+
+#if defined(TASK_PERSIST)
+// keep the eeprom in a file, like the real thing keeps it over a reset,
+// so the persisted task list and the functions it runs come back
+#include <fcntl.h>
+#include <sys/mman.h>
+#define EEPROM_IMAGE "eeprom.img"
+
+void init_fake_eeprom(void) {
+	int fd = open(EEPROM_IMAGE, O_RDWR | O_CREAT, 0644);
+	if (fd >= 0) {
+		off_t size = lseek(fd, 0, SEEK_END);
+		if ((size == E2END+1) || ((size == 0) && (ftruncate(fd, E2END+1) == 0))) {
+			void *image = mmap(0, E2END+1, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (image != MAP_FAILED) {
+				fake_eeprom = (byte *) image;
+				close(fd);
+				if (size == 0) memset(fake_eeprom, 0xff, E2END+1);		// a fresh eeprom is erased
+				return;
+			}
+		}
+		close(fd);
+	}
+	sp("Cannot open " EEPROM_IMAGE "; the eeprom will not be kept\n");
+	memset(fake_eeprom, 0xff, E2END+1);
+}
+#else
 void init_fake_eeprom(void) {
 int i=0;
 	while (i <= E2END) eewrite(i++, 0xff);
 }
+#endif
 
 FILE *savefd;
 void fputbyte(byte b) {
@@ -246,47 +399,255 @@ numvar func_save(void) {
 
 
 
-// background function thread
+#if defined(TASK_WORKERS)
+// background worker threads
+// Each worker runs in a context of its own and takes the next due task.
+// Workers hold the executing lock shared, so they run in parallel with
+// each other; the foreground holds it exclusively while it runs a command,
+// so definitions made at the prompt never race a running task.
 #include <pthread.h>
-pthread_mutex_t executing;
-pthread_t background_thread;
-struct timespec wait_time;
+#define MAXWORKERS 8
+pthread_rwlock_t executing;
+pthread_t background_threads[MAXWORKERS];
 
 void *BackgroundMacroThread(void *threadid) {
+	bitlash_ctx *ctx = bitlash_ctx_new();
+	if (!ctx) return 0;
+	bitlash_setctx(ctx);
 	for (;;) {
-		pthread_mutex_lock(&executing);
-		runBackgroundTasks();
-		pthread_mutex_unlock(&executing);
-
-		// sleep until next task runtime
-		unsigned long sleep_time = millisUntilNextTask();
-		if (sleep_time) {
-			unsigned long seconds = sleep_time / 1000;
-			wait_time.tv_sec = seconds;
-			wait_time.tv_nsec = (sleep_time - (seconds * 1000)) * 1000000L;
-			while (nanosleep(&wait_time, &wait_time) == -1) continue;
+		if (!suspendBackground) {
+			pthread_rwlock_rdlock(&executing);
+			int slot = claimTask();
+			if (slot >= 0) runTask(slot);
+			pthread_rwlock_unlock(&executing);
+			if (slot >= 0) continue;		// look for more work right away
 		}
+
+		waitForTask();		// sleep until the next task is due, or one is started
 	}
 	return 0;
 }
 
+void startWorkers(void) {
+	pthread_rwlockattr_t attr;
+	pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+	// busy workers must not lock out the command line
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	pthread_rwlock_init(&executing, &attr);
+
+	long workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers < 1) workers = 1;
+	if (workers > MAXWORKERS) workers = MAXWORKERS;
+	long i;
+	for (i=0; i < workers; i++) {
+		pthread_create(&background_threads[i], NULL, BackgroundMacroThread, (void *) i);
+	}
+}
 
-numvar func_system(void) {
-	return system((char *) getarg(1));
+#else
+// event loop
+// One thread serves the command line, the background tasks and ^C, as on
+// the device: it sleeps until stdin has input, the task timer expires,
+// or SIGINT arrives, and handles each in turn.  Nothing runs concurrently,
+// so no locking is needed.
+//
+// On Linux this is epoll, with a timerfd for the tasks and a signalfd
+// for SIGINT.  Elsewhere it is poll() with a timeout and a signal handler.
+// Other fds may be added with addEventSource(); the handler gets the fd.
+//
+#define MAXSOURCES 16
+struct {
+	int fd;
+	void (*handler)(int);
+	byte ready;			// regular file: always readable, epoll refuses it
+} sources[MAXSOURCES];
+int numsources;
+byte looping;
+
+#ifdef __linux__
+int epfd = -1, timerfd = -1, sigfd = -1;
+
+byte checksignals(void) {
+	struct signalfd_siginfo info;
+	struct pollfd pfd = { sigfd, POLLIN, 0 };
+	if (poll(&pfd, 1, 0) <= 0) return 0;
+	return read(sigfd, &info, sizeof(info)) == sizeof(info);
 }
+#else
+volatile sig_atomic_t sigint_received;
+void inthandler(int signal) { sigint_received = 1; }
 
-numvar func_exit(void) {
-	if (getarg(0) > 0) exit(getarg(1));
-	exit(0);
+byte checksignals(void) {
+	if (!sigint_received) return 0;
+	sigint_received = 0;
+	return 1;
+}
+#endif
+
+int addEventSource(int fd, void (*handler)(int)) {
+	if (numsources >= MAXSOURCES) return 0;
+	sources[numsources].fd = fd;
+	sources[numsources].handler = handler;
+	sources[numsources].ready = 0;
+#ifdef __linux__
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u32 = numsources;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		if (errno != EPERM) return 0;
+		sources[numsources].ready = 1;
+	}
+#endif
+	numsources++;
+	return 1;
 }
 
+void runDueTasks(void);
+void endofinput(void);
+
+// feed whatever has arrived on stdin to the command line editor,
+// unless a task is waiting for it in getkey() or getnum(), or runs on input
+void stdinhandler(int fd) {
+	if (keywaiters || inputtasks) {
+		pollinput();				// still honor ^C
+		if (break_received) {
+			break_received = 0;
+			doCharacter(3);
+		}
+		else runDueTasks();
+		if (input_eof && (inhead == intail)) endofinput();
+		return;
+	}
+	while (looping && serialAvailable()) {
+		char c = serialRead();
+		doCharacter(c);
+		if ((c == '\r') || (c == '\n')) runDueTasks();	// the command may have tripped a trigger
+	}
+	if (input_eof) {
+		if (lbufptr != lbuf) doCharacter('\n');		// last line had no newline
+		endofinput();
+	}
+}
 
-#include <signal.h>
+// stop at the end of the input, or on the virtual clock at the horizon
+void endofinput(void) {
+	if (!virtualtime || (millis() >= horizon)) looping = 0;
+}
 
-byte break_received;
+// with the virtual clock, time passes only when there is nothing else
+// to do: then move it on to the next task and run that
+void ticktock(void) {
+	if ((inhead != intail) || suspendBackground) return;
+	long due = nextTaskDue();
+	if (due < 0) {					// nothing will ever happen
+		if (input_eof) looping = 0;
+		return;
+	}
+	if (input_eof && (millis() + due >= horizon)) {
+		virtualus = horizon * 1000ULL;
+		looping = 0;
+		return;
+	}
+	virtualus += due * 1000ULL;
+	runDueTasks();
+}
+
+// run every task that is due, but give input a look in now and then
+void runDueTasks(void) {
+	int runs = 0;
+	while (!suspendBackground && (runs++ < 100)) {
+		int slot = claimTask();
+		if (slot < 0) break;
+		runTask(slot);
+	}
+	if (!keywaiters && !inputtasks && (inhead != intail)) stdinhandler(0);	// input a task left
+}
+
+#ifdef __linux__
+void timerhandler(int fd) {
+	unsigned long long expirations;
+	if (read(fd, &expirations, sizeof(expirations)) < 0) {;}
+	runDueTasks();
+}
+
+void signalhandler(int fd) {
+	if (checksignals()) doCharacter(3);
+}
+
+// wake for the next task; a suspended task list needs no timer
+void armtimer(void) {
+	struct itimerspec when = {{0, 0}, {0, 0}};
+	if (!suspendBackground && !virtualtime) {
+		unsigned long ms = millisUntilNextTask();
+		when.it_value.tv_sec = ms / 1000;
+		when.it_value.tv_nsec = ((ms % 1000) * 1000000L) + 1;	// zero would disarm it
+	}
+	timerfd_settime(timerfd, 0, &when, NULL);
+}
+#endif
+
+void eventloop(void) {
+	initterm();
+#ifdef __linux__
+	sigset_t sigs;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigprocmask(SIG_BLOCK, &sigs, NULL);
+	sigfd = signalfd(-1, &sigs, SFD_CLOEXEC);
+	timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	addEventSource(sigfd, signalhandler);
+	addEventSource(timerfd, timerhandler);
+#else
+	signal(SIGINT, inthandler);
+#endif
+	addEventSource(0, stdinhandler);
+
+	looping = 1;
+	while (looping) {
+		int i, timeout = -1;
+		for (i=0; i < numsources; i++) if (sources[i].ready) timeout = 0;
+		if (virtualtime && !suspendBackground && (nextTaskDue() >= 0)) timeout = 0;	// no waiting for the clock
+#ifdef __linux__
+		struct epoll_event events[MAXSOURCES];
+		armtimer();
+		int n = epoll_wait(epfd, events, MAXSOURCES, timeout);
+		for (i=0; i < n && looping; i++) {
+			int s = events[i].data.u32;
+			(*sources[s].handler)(sources[s].fd);
+		}
+#else
+		struct pollfd pfds[MAXSOURCES];
+		if ((timeout < 0) && !suspendBackground) timeout = millisUntilNextTask();
+		for (i=0; i < numsources; i++) {
+			pfds[i].fd = sources[i].fd;
+			pfds[i].events = POLLIN;
+		}
+		int n = poll(pfds, numsources, timeout);
+		for (i=0; i < numsources && n > 0 && looping; i++) {
+			if (pfds[i].revents && !sources[i].ready) (*sources[i].handler)(sources[i].fd);
+		}
+		if (checksignals()) doCharacter(3);
+		runDueTasks();
+#endif
+		for (i=0; i < numsources && looping; i++) {
+			if (sources[i].ready) (*sources[i].handler)(sources[i].fd);
+		}
+		if (virtualtime && looping) ticktock();
+	}
+}
+#endif
+
+
+numvar func_system(void) {
+	return system((char *) getarg(1));
+}
 
-void inthandler(int signal) {
-	break_received = 1;
+numvar func_exit(void) {
+	if (getarg(0) > 0) exit(getarg(1));
+	exit(0);
 }
 
 
@@ -327,22 +688,47 @@ int main () {
 	addBitlashFunction("fprintf", (bitlash_function) &func_fprintf);
 
 
+	// size the task table
+	char *tasklimit = getenv("BITLASH_TASKS");
+	if (tasklimit) {
+		char *end;
+		long limit = strtol(tasklimit, &end, 10);
+		if ((end == tasklimit) || *end || (limit < 1) || (limit != (int) limit) || !setTaskLimit(limit)) {
+			sp("Cannot make a task table of BITLASH_TASKS="); sp(tasklimit); sp(" tasks\n");
+		}
+	}
+
+#if !defined(TASK_WORKERS)
+	// run on the virtual clock
+	char *vclock = getenv("BITLASH_VIRTUAL");
+	if (vclock) {
+		virtualtime = 1;
+		horizon = strtoul(vclock, NULL, 10);
+	}
+#endif
+
 	init_millis();
 	initBitlash(0);
+#if defined(TASK_PERSIST)
+	restoreTasks();			// the functions above are all in place
+#endif
 
-	//signal(SIGINT, inthandler);
-	//signal(SIGKILL, inthandler);
-
-	// run background functions on a separate thread
-	pthread_create(&background_thread, NULL, BackgroundMacroThread, 0);
+#if defined(TASK_WORKERS)
+	// run background functions on worker threads
+	startWorkers();
 
 	// run the main stdin command loop
 	for (;;) {
 		char * ret = fgets(lbuf, STRVALLEN, stdin);
 		if (ret == NULL) break;	
+		pthread_rwlock_wrlock(&executing);
 		doCommand(lbuf);
+		pthread_rwlock_unlock(&executing);
 		initlbuf();
 	}
+#else
+	eventloop();
+#endif
 
 #if 0
 	unsigned long next_key_time = 0L;
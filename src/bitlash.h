@@ -94,6 +94,11 @@
 // cost: ~400 bytes flash
 //#define PARSER_TRACE 1
 
+//
+// Enable EXEC_STATS to count the statements, tokens and bytes the interpreter
+// goes through, and add the stats function to print them; stats(0) clears them
+//#define EXEC_STATS 1
+
 
 
 ////////////////////////////////////////////////////
@@ -407,6 +412,21 @@ void beginSerial(unsigned long baud) { ; }
 #define pgm_read_word(addr) (*(int *) (addr))
 
 unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long);
+extern byte virtualtime;				// on the virtual clock; see bitlash-unix.c
+int serialAvailable(void);
+int digitalRead(uint8_t);
+int analogRead(uint8_t);
+
+// bitlash-unix.c
+void pollinput(void);
+int addEventSource(int, void (*)(int));
+
+// bitlash-unix-prof.c
+void startProfiler(void);
+void stopProfiler(void);
+void dumpProfile(void);
 
 #endif	// defined unix_build
 
@@ -516,6 +536,7 @@ int getValue(char *key);			// return location of macro value in EEPROM or -1
 
 int findoccupied(int);
 int findend(int);
+char eestrmatch(int, char *);
 void eeputs(int);
 
 #define EMPTY ((uint8_t)255)
@@ -539,19 +560,33 @@ void eeputs(int);
 //
 // Use the predefined constant from the avr-gcc support file
 //
+// Define TASK_PERSIST to keep the list of running tasks in the last
+// TASKDB_LEN bytes of the EEPROM, so they start again at reset without
+// a startup script; see restoreTasks().  On Unix the EEPROM is then kept
+// in the file eeprom.img.
+//
+//#define TASK_PERSIST
+#if defined(TASK_PERSIST)
+	#define TASKDB_LEN 64
+#else
+	#define TASKDB_LEN 0
+#endif
+
 #if defined(EEPROM_MICROCHIP_24XX32A)
-	#define ENDDB 4095
+	#define ENDDB (4095 - TASKDB_LEN)
 	#define ENDEEPROM 4095
 #else
-	#define ENDDB E2END
+	#define ENDDB (E2END - TASKDB_LEN)
 	#define ENDEEPROM E2END
 #endif
+#define TASKDB (ENDDB + 1)			// the persisted task list, to ENDEEPROM
 
 /////////////////////////////////////////////
 // bitlash-error.c
 //
 extern jmp_buf env;
 #define X_EXIT 1
+#define X_BUDGET 2				// a task ran over its budget; see chkbudget()
 void fatal2(char, char);
 void overflow(byte);
 void underflow(byte);
@@ -568,12 +603,15 @@ void missing(byte);
 typedef numvar (*bitlash_function)(void);
 void show_user_functions(void);
 
-void dofunctioncall(byte);
+void dofunctioncall(int);
+int addBitlashFunction(const char *, bitlash_function);	// returns token or FAIL
+char find_user_function(char *);
 numvar func_free(void);
 void make_beep(unumvar, unumvar, unumvar);
 
 extern const prog_char functiondict[] PROGMEM;
 extern const prog_char aliasdict[] PROGMEM;
+extern const prog_char reservedwords[] PROGMEM;
 
 void stir(byte);
 
@@ -612,8 +650,10 @@ void resetOutputHandler(void);
 extern serialOutputFunc serial_override_handler;
 #endif
 
-#ifdef ARDUINO_BUILD
+#if !defined(TINY_BUILD)
 void chkbreak(void);
+#endif
+#ifdef ARDUINO_BUILD
 void cmd_print(void);
 #endif
 numvar func_printf_handler(byte, byte);
@@ -622,14 +662,118 @@ numvar func_printf_handler(byte, byte);
 /////////////////////////////////////////////
 // bitlash-taskmgr.c
 //
+// On Unix the command line and background tasks share one thread,
+// driven by the event loop in bitlash-unix.c, as on the device.
+// Define TASK_WORKERS to run tasks in parallel on a pool of worker threads.
+#if defined(UNIX_BUILD)
+//#define TASK_WORKERS
+#endif
+
+// Without worker threads, a task that calls delay() runs as a coroutine
+// on a stack of its own, and delay() suspends it instead of holding up
+// every other task.  getkey() and getnum() likewise wait without blocking.
+#if defined(UNIX_BUILD) && !defined(TASK_WORKERS)
+#define TASK_COROUTINES
+#endif
+
+// On Unix and ARM the task table is sized at run time; see setTaskLimit()
+// and tasks wait in a heap ordered by wake time.  AVR keeps a fixed table.
+//
+// Define TASK_WHEEL to keep them on a hierarchical timer wheel instead,
+// which is cheaper with many thousands of tasks.
+//
+//#define TASK_WHEEL
+//
+// When several tasks are due the one of highest priority runs first, then
+// the one that woke first.  Define TASK_EDF to run the one with the 
+// earliest deadline, the end of its period, first instead.
+//
+//#define TASK_EDF
+//
+// Define TASK_LATENCY to time each command and each task run into a
+// histogram, for the lat function.  Not on AVR, which hasn't the room.
+//
+//#define TASK_LATENCY
+#if defined(AVR_BUILD)
+#undef TASK_LATENCY
+#define NUMTASKS 10
+typedef byte taskid;
+#else
+#define TASK_TABLE
+#if defined(UNIX_BUILD)
+#define NUMTASKS 256
+#else
+#define NUMTASKS 32
+#endif
+typedef int taskid;
+byte setTaskLimit(int);
+
+// scheduling policies; see setTaskRate()
+#define RATE_DELAY		0		// next run is snoozetime after this one ends
+#define RATE_BURST		1		// fixed rate; catch up by running back to back
+#define RATE_SKIP		2		// fixed rate; drop missed periods
+#define RATE_COALESCE	3		// fixed rate; one run for all missed periods
+void setTaskRate(taskid, byte);
+void setTaskPriority(taskid, int);
+taskid startScriptTask(byte, numvar, char *, numvar);
+
+// event triggers; see setTaskTrigger()
+#define TRIG_NONE		0
+#define TRIG_CHANGE		1		// digital pin changes
+#define TRIG_RISING		2
+#define TRIG_FALLING	3
+#define TRIG_ABOVE		4		// analog pin goes above the threshold
+#define TRIG_BELOW		5		// or below it
+#define TRIG_VAR		6		// variable changes
+#define TRIG_INPUT		7		// serial input is waiting
+void setTaskTrigger(taskid, byte, byte, numvar);
+void checkTriggers(void);
+extern int inputtasks;
+
+// statement and microsecond budgets per run; see setTaskBudget()
+void setTaskBudget(taskid, unsigned long, unsigned long);
+void chkbudget(void);
+extern byte budgeted;
+
+// millis until the next task is due, or -1 if none is waiting on the clock
+long nextTaskDue(void);
+
+#if defined(TASK_LATENCY)
+// run time histograms; see showLatency()
+void commandLatency(unsigned long);
+void showLatency(void);
+void clearLatency(void);
+byte exportLatency(char *);
+#endif
+#endif
+
 void initTaskList(void);
 void runBackgroundTasks(void);
-void stopTask(byte);
-void startTask(int, numvar);
+int claimTask(void);
+void runTask(taskid);
+unsigned long millisUntilNextTask(void);
+#ifdef TASK_WORKERS
+void waitForTask(void);
+#endif
+#ifdef TASK_COROUTINES
+byte yieldTask(unsigned long);
+void waitForKey(void);
+extern int keywaiters;
+#else
+#define waitForKey() while (!serialAvailable()) {;}		// blocking!
+#endif
+void stopTask(taskid);
+taskid startTask(int, numvar);
+#if defined(TASK_PERSIST)
+void saveTasks(void);
+void restoreTasks(void);				// once, after the host adds its C functions
+#else
+#define saveTasks()
+#endif
 void snooze(unumvar);
-void showTaskList(void);
+void showTaskList(taskid);
 extern byte background;
-extern byte curtask;
+extern taskid curtask;
 extern byte suspendBackground;
 
 
@@ -646,6 +790,10 @@ void eewrite(int, byte);
 byte eeread(int);
 extern char virtual_eeprom[];
 void eeinit(void);
+
+#elif defined(UNIX_BUILD)
+void eewrite(int, byte);				// fake_eeprom; see bitlash-unix.c
+byte eeread(int);
 #endif
 
 
@@ -660,14 +808,14 @@ void domacrocall(int);
 // bitlash-parser.c
 //
 void vinit(void);							// init the value stack
+void vfree(void);							// free the value stack and pool chunks, with BITLASH_CONTEXT
 void vpush(numvar);							// push a numvar on the stack
 numvar vpop(void);							// pop a numvar
-extern byte vsptr;
-#define vsempty() vsptr==0
 extern numvar *arg;								// argument frame pointer
 numvar getVar(uint8_t id);					// return value of bitlash variable.  id is [0..25] for [a..z]
 void assignVar(uint8_t id, numvar value);	// assign value to variable.  id is [0..25] for [a..z]
 numvar incVar(uint8_t id);					// increment variable.  id is [0..25] for [a..z]
+numvar addVar(uint8_t id, numvar n);		// add n to variable and return the new value
 
 // parse context types
 #define SCRIPT_NONE		0
@@ -675,19 +823,45 @@ numvar incVar(uint8_t id);					// increment variable.  id is [0..25] for [a..z]
 #define SCRIPT_PROGMEM 	2
 #define SCRIPT_EEPROM 	3
 #define SCRIPT_FILE		4
+#define SCRIPT_FUNCTION	5		// a built-in or user C function run as a task
 
 byte findscript(char *);
+void resolveid(void);
+
+// On Unix and ARM the value stack and the string pool grow on demand
+// in chunks from the heap; on AVR they share one fixed array.
+#if !defined(AVR_BUILD)
+#define SEGMENTED_STACK
+#endif
+#define STRING_POOL
+
+// Cache identifier resolution at call sites in EEPROM and PROGMEM scripts.
+// Anything that may change what a name means must call newdefinition().
+#if !defined(AVR_BUILD)
+#define CALL_CACHE
+#endif
+#ifdef CALL_CACHE
+#if defined(UNIX_BUILD)
+extern _Atomic unsigned long defgeneration;	// any thread may bump it
+#else
+extern unsigned long defgeneration;
+#endif
+#define newdefinition() (++defgeneration)
+#else
+#define newdefinition()
+#endif
 byte scriptfileexists(char *);
 numvar execscript(byte, numvar, char *);
 void callscriptfunction(byte, numvar);
 
 typedef struct {
-	numvar fetchptr;
-	byte fetchtype;
+	numvar ptr;
+	byte type;
 } parsepoint;
 
 void markparsepoint(parsepoint *);
 void returntoparsepoint(parsepoint *, byte);
+void initparsepoint(byte, numvar, char *);
 void primec(void);
 void fetchc(void);
 void getsym(void);
@@ -697,6 +871,10 @@ numvar func_fprintf(void);
 
 const prog_char *getmsg(byte);
 void parsestring(void (*)(char));
+numvar getstringliteral(void);
+#ifdef CALL_CACHE
+void reclaimliterals(void);
+#endif
 void msgp(byte);
 void msgpl(byte);
 numvar getnum(void);
@@ -707,8 +885,17 @@ byte is_end(void);
 numvar getarg(numvar);
 numvar isstring(void);
 numvar getstringarg(numvar);
+byte findindex(char *, const prog_char *, byte);
 void releaseargblock(void);
-void parsearglist(void);
+void parsearglist(byte);
+
+// argblock layout; see bitlash-parser.c
+#define ARGC_MASK		0x7f	// arg[0]: the arg count
+#define ARG_NAMED		0x80	// arg[0]: frame has the function name at arg[2]
+#define ARGTYPE_SHIFT	8		// arg[0]: string argument bits start here
+#define argcount(a)		((a)[0] & ARGC_MASK)
+#define argparent(a)	((numvar *) (a)[1])
+#define argname(a)		(((a)[0] & ARG_NAMED) ? (char *) (a)[2] : (char *) 0)
 extern const prog_char reservedwords[];
 
 
@@ -737,6 +924,7 @@ void tb(void);
 #endif
 
 
+
 // Expression result
 extern byte exptype;				// type of expression: s_nval [or s_sval]
 extern numvar expval;				// value of numeric expr or length of string
@@ -746,6 +934,181 @@ extern numvar expval;				// value of numeric expr or length of string
 extern char idbuf[IDLEN+1];
 
 
+/////////////////////////////////////////////
+// Interpreter state
+//
+// These are the parser's private structures; they live here so that
+// the interpreter context below can hold them.
+//
+#if defined(SEGMENTED_STACK)
+#define VCHUNKLEN 256
+typedef struct vchunk {
+	struct vchunk *prev;		// chunk below us in the chain
+	numvar *savedsp;			// prev's stack pointer when we were entered
+	numvar slots[VCHUNKLEN];
+} vchunk;
+
+#define POOLCHUNKLEN 4096
+typedef struct poolchunk {
+	struct poolchunk *prev;
+	char *limit;				// one past the last byte
+	char bytes[POOLCHUNKLEN];
+} poolchunk;
+
+#define NAMEHASHLEN 64			// must be a power of two
+typedef struct namenode {
+	struct namenode *next;
+	char name[IDLEN+1];
+} namenode;
+#endif
+
+#ifdef CALL_CACHE
+#define CALLCACHELEN 64			// must be a power of two
+typedef struct {
+	numvar site;				// script address of the identifier
+	numvar value;				// the symval it resolved to
+	unsigned long generation;	// defgeneration when cached; 0 is never valid
+	byte type;					// fetchtype of the script
+	byte token;					// the sym it resolved to
+} callcache_entry;
+
+#define LITCACHELEN 32			// must be a power of two
+#define LITPOOLSIZE 2048
+typedef struct {
+	numvar site;				// script address of the literal's first char
+	numvar end;					// script address just past its closing quote
+	char *str;					// the parsed string in litpool
+	unsigned long generation;	// defgeneration when cached; 0 is never valid
+	byte type;					// fetchtype of the script
+} litcache_entry;
+#endif
+
+// filename buffer for 8.3 + \0
+#define FNAMELEN 13
+
+#ifdef EXEC_STATS
+// execution counters, kept by each context; see func_stats()
+#if defined(UNIX_BUILD)
+#define HOTSPOTS 64					// functions counted by name; calls to others are lumped
+#else
+#define HOTSPOTS 8
+#endif
+#define CALL_BUILTIN SCRIPT_NONE	// hotspot type of a built-in
+
+typedef struct {
+	char name[IDLEN+1];
+	byte type;						// CALL_BUILTIN, SCRIPT_FUNCTION for a C function, or the script type
+	unsigned long calls;
+} hotspot;
+
+typedef struct {
+	unsigned long statements;				// getstatement()
+	unsigned long tokens[SCRIPT_FILE+1];	// getsym(), by fetchtype
+	unsigned long bytes[SCRIPT_FILE+1];		// primec(), by fetchtype
+	unsigned long scriptcalls[SCRIPT_FILE+1];	// callscriptfunction(), by script type
+	hotspot calls[HOTSPOTS];				// dofunctioncall() and callscriptfunction(), by function
+	unsigned long othercalls;				// calls to functions that didn't fit
+} execstats;
+extern execstats execcounts;
+#define countstat(counter) (CTX(execcounts).counter++)
+void countcall(byte, char *);
+void addstats(execstats *, execstats *);
+execstats *sumstats(void);				// the counts of every context together
+void clearstats(void);
+#else
+#define countstat(counter)
+#define countcall(type, name)
+#endif
+
+
+/////////////////////////////////////////////
+// Interpreter context
+//
+// On Unix everything a running interpreter owns lives in a bitlash_ctx,
+// so several interpreters can run at once, each on its own thread.
+// bitlash_cur is thread-local, and the globals declared above are not used.
+//
+// The interpreter reaches its state through CTX(name): a field of the
+// current context on Unix, the global of that name elsewhere.
+//
+// Contexts share the variables a-z, the task list, the user function
+// table, EEPROM and the output handler.  Each thread starts out in the
+// main context.
+//
+#if defined(UNIX_BUILD)
+#define BITLASH_CONTEXT
+#endif
+
+#ifdef BITLASH_CONTEXT
+typedef struct bitlash_ctx {
+	// parser
+	byte fetchtype;
+	numvar fetchptr;
+	numvar symval;
+	byte sym;
+	byte inchar;
+	byte exptype;
+	numvar expval;
+	char idbuf[IDLEN+1];
+	jmp_buf env;
+	byte polls;						// statements since chkbreak() looked at input
+
+	// value stack and string pool
+	numvar *arg;
+	vchunk vstackbase;
+	vchunk *vchunkp;
+	vchunk *vspare;
+	byte vchunks;
+	numvar *vsp;
+	numvar *vsbottom;
+	poolchunk poolbase;
+	poolchunk *poolchunkp;
+	poolchunk *poolspare;
+	byte poolchunks;
+	char *stringPool;
+	namenode *namehash[NAMEHASHLEN];
+
+	// caches
+	callcache_entry callcache[CALLCACHELEN];
+	litcache_entry litcache[LITCACHELEN];
+	char litpool[LITPOOLSIZE];
+	int litpoolused;
+	unsigned long litgeneration;
+
+	// task being run, if any, and its budget
+	byte background;
+	taskid curtask;
+	byte budgeted;
+	unsigned long stepsrun;
+	unsigned long stepbudget;
+	unsigned long usbudget;
+	unsigned long runstart;
+
+	// script files
+	FILE *scriptfile;
+	byte scriptfile_is_open;
+	char cachedname[FNAMELEN];
+	byte cachedflags;
+
+#ifdef EXEC_STATS
+	execstats execcounts;
+	struct bitlash_ctx *nextctx;	// on the list sumstats() goes through
+#endif
+} bitlash_ctx;
+
+extern __thread bitlash_ctx *bitlash_cur;
+
+bitlash_ctx *bitlash_ctx_new(void);
+void bitlash_ctx_free(bitlash_ctx *);
+bitlash_ctx *bitlash_setctx(bitlash_ctx *);			// returns the previous context
+numvar bitlash_exec(bitlash_ctx *, char *);
+
+#define CTX(name)				(bitlash_cur->name)
+#else
+#define CTX(name)				(name)
+#endif
+
+
 // Strings live in PROGMEM to save ram
 //
 #define M_expected		0
@@ -777,6 +1140,7 @@ extern char idbuf[IDLEN+1];
 #define M_oops			26
 #define M_arg			27
 #define M_function		28
+#define M_dup			29
 
 
 //	Names for symbols
@@ -826,6 +1190,7 @@ extern char idbuf[IDLEN+1];
 #define s_script_progmem (36 | 0x80)
 #define s_script_file	(37 | 0x80)
 #define s_comment		(38 | 0x80)
+#define s_prof			(39 | 0x80)
 
 
 // Names for literal symbols: these one-character symbols 
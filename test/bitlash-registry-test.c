@@ -0,0 +1,50 @@
+/***
+	bitlash-registry-test.c: the Unix build with a thousand more C functions,
+	for the user function registry checks in bitlash-unix-test.sh
+
+	Before the usual startup it adds fn0 to fn999, each returning the last
+	digit of its number, so the table and its hash index grow many times
+	over.  Then it tries names that are taken: fn7 again, the built-in abs,
+	and the reserved words while and print.  Each of those is refused with
+	"duplicate", and the first holder of the name keeps it.
+
+	Built by make test in src/:
+		gcc -pthread -Dmain=unix_main -I. *.c ../test/bitlash-registry-test.c -o bin/bitlash-registry
+
+	See the file LICENSE for license terms.
+
+***/
+#undef main			// the interpreter's main is renamed on the command line
+#include "bitlash.h"
+
+int unix_main(void);
+
+#define FUNCTIONS 1000
+
+numvar digit0(void) { return 0; }
+numvar digit1(void) { return 1; }
+numvar digit2(void) { return 2; }
+numvar digit3(void) { return 3; }
+numvar digit4(void) { return 4; }
+numvar digit5(void) { return 5; }
+numvar digit6(void) { return 6; }
+numvar digit7(void) { return 7; }
+numvar digit8(void) { return 8; }
+numvar digit9(void) { return 9; }
+
+bitlash_function digits[] = { digit0, digit1, digit2, digit3, digit4, digit5, digit6, digit7, digit8, digit9 };
+
+char names[FUNCTIONS][8];		// the registry keeps the pointers, not copies
+
+int main(int argc, char **argv) {
+	int i;
+	for (i = 0; i < FUNCTIONS; i++) {
+		sprintf(names[i], "fn%d", i);
+		addBitlashFunction(names[i], digits[i % 10]);
+	}
+	addBitlashFunction("fn7", digit0);
+	addBitlashFunction("abs", digit0);
+	addBitlashFunction("while", digit0);
+	addBitlashFunction("print", digit0);
+	return unix_main();
+}
@@ -0,0 +1,236 @@
+#! /bin/sh
+#
+#	Bitlash Unix build test script
+#
+#	Runs scripts through the Unix build on the virtual clock and checks
+#	what they print.  Run from src/ with "make test", or by hand:
+#		sh ../test/bitlash-unix-test.sh [bitlash [wheel [persist [registry]]]]
+#
+#	The wheel binary is built with -DTASK_WHEEL -DTASK_EDF, the persist
+#	binary with -DTASK_PERSIST, and the registry binary adds the C
+#	functions of bitlash-registry-test.c; the checks that need one are
+#	skipped when there is none.
+#
+#	See the file LICENSE for license terms.
+#
+###############################################################################
+
+bitlash=${1:-bin/bitlash}
+wheel=${2:-bin/bitlash-wheel}
+persist=${3:-bin/bitlash-persist}
+registry=${4:-bin/bitlash-registry}
+failed=0
+out=`mktemp`
+home=`mktemp -d`		# the binary works in ~/.bitlash; keep it off the real one
+trap 'rm -rf $out $home' EXIT
+
+# check name horizon expected script
+# runs script to the virtual horizon (ms) and looks for expected in its output
+check() {
+	checkwith $bitlash "$@"
+}
+
+# checkwith binary name horizon expected script
+# the same, with another build of bitlash
+# each check starts with an empty ~/.bitlash, unless keep is set
+checkwith() {
+	build=$1
+	shift
+	if [ ! -x $build ]; then
+		echo "skip $1: no $build"
+		return
+	fi
+	if [ -z "$keep" ]; then
+		rm -rf $home/.bitlash
+		mkdir $home/.bitlash
+	fi
+	printf '%s' "$4" | HOME=$home BITLASH_VIRTUAL=$2 timeout 10 $build > $out 2>&1
+	rc=$?
+	output=`tr -d '\\r' < $out`
+	if [ $rc -ne 0 ]; then
+		echo "FAIL $1: exit status $rc"
+		failed=1
+	elif ! echo "$output" | grep -q "$3\$"; then
+		echo "FAIL $1: expected \"$3\""
+		echo "$output" | tail -5
+		failed=1
+	else
+		echo "ok   $1"
+	fi
+}
+
+# a task that never finishes, preempted by its statement budget, must let
+# the clock move on: the other task runs, and the run ends at the horizon
+check "budget preemption on the virtual clock" 10000 "got 1 1" \
+'function loop {while 1 {y++}}
+function other {z++}
+function done {print "got", z >= 90, y > 0; stop *}
+run loop,10 budget 1000
+run other,100
+run done,9999
+'
+
+# the run queue hands out tasks in wake time order, however they were
+# started, and keeps that order as periodic tasks are put back
+check "run queue order of one-shot tasks" 1000 "got 12345678" \
+'function pa {s=s*10+1; stop}
+function pb {s=s*10+2; stop}
+function pc {s=s*10+3; stop}
+function pd {s=s*10+4; stop}
+function pe {s=s*10+5; stop}
+function pf {s=s*10+6; stop}
+function pg {s=s*10+7; stop}
+function ph {s=s*10+8; stop}
+function done {print "got", s; stop *}
+run pe,50
+run ph,80
+run pb,20
+run pg,70
+run pa,10
+run pd,40
+run pf,60
+run pc,30
+run done,100
+'
+
+check "run queue order of periodic tasks" 1000 "got 11211211" \
+'function fast {s=s*10+1}
+function slow {s=s*10+2}
+function done {print "got", s; stop *}
+run slow,70
+run fast,30
+run done,200
+'
+
+# the timer wheel must run the periodic tasks in the same order
+checkwith $wheel "timer wheel order of periodic tasks" 1000 "got 11211211" \
+'function fast {s=s*10+1}
+function slow {s=s*10+2}
+function done {print "got", s; stop *}
+run slow,70
+run fast,30
+run done,200
+'
+
+# tasks filed on the outer wheels are cascaded in on time: far waits on
+# the second wheel out and past on the fourth, while near and mid keep
+# coming round; none may start late, or the counts fall short
+cascade='function near {n++}
+function mid {m++}
+function far {print "far", millis, m, n}
+function past {print "past", millis, m, n; stop *}
+run near,300
+run mid,1000
+run far,70001
+run past,16800001
+'
+for build in $bitlash $wheel; do
+	checkwith $build "second wheel cascade on $build" 17000000 "far 70001 70 233" "$cascade"
+	checkwith $build "fourth wheel cascade on $build" 17000000 "past 16800001 16800 56000" "$cascade"
+done
+
+# of the tasks due together, higher priorities run first
+priority='function la {s=s*10+1; stop}
+function lb {s=s*10+2; stop}
+function lc {s=s*10+3; stop}
+function done {print "got", s; stop *}
+run la,100,1
+run lb,100,3
+run lc,100,2
+run done,200
+'
+check "priority order" 1000 "got 231" "$priority"
+checkwith $wheel "priority order with deadlines" 1000 "got 231" "$priority"
+
+# with TASK_EDF, of two tasks due at 300 the one whose period ends
+# first runs first, unless the other has the higher priority
+deadlines='function slow {s=s*10+1; stop}
+function fast {if millis == 300 {s=s*10+2; stop;}}
+function done {print "got", s; stop *}
+'
+checkwith $wheel "earliest deadline first" 1000 "got 21" "$deadlines
+run slow,300
+run fast,100
+run done,400
+"
+checkwith $wheel "priority before deadline" 1000 "got 12" "$deadlines
+run slow,300,1
+run fast,100
+run done,400
+"
+
+# triggered tasks run on a pin edge or a change of variable, once for
+# each, and not on the clock; toggle makes 50 rising and 50 falling edges
+check "pin edge and variable triggers" 20000 "got 50 50 50 0" \
+'function toggle {d3 = !d3}
+function rising {r++}
+function falling {f++}
+function watch {w++}
+function never {z++}
+function done {print "got", r, f, w, z; stop *}
+run toggle,100
+run rising on d3 rising
+run falling on d3 falling
+run watch on r
+run never on d4
+run done,10050
+'
+
+# an input task runs while input waits, and the input is its to read
+check "input trigger" 5000 "got 3" \
+'function reader {k = getkey(); if k == 10 {n++}}
+function done {print "got", n; stop *}
+run done,1000
+run reader on input
+abc
+de
+f
+'
+
+# the running tasks are saved as they are started, and are back at the
+# next start with their periods, rates, priorities and triggers
+checkwith $persist "tasks started" 300 "2: pwd every 5000 runs 0 late 0/0" \
+'function tick {t++}
+function edge {e++}
+run tick,100,2 fixed skip
+run edge on d5 rising
+run pwd,5000
+ps
+'
+keep=1
+checkwith $persist "periodic task restored" 300 "0: tick every 100 skip prio 2 runs 0 late 0/0 missed 0" 'ps
+'
+checkwith $persist "triggered task restored" 300 "1: edge on d5 rising runs 0 late 0/0" 'ps
+'
+checkwith $persist "restored tasks run" 2000 "got 10 1" \
+'function done {print "got", t, e; stop *}
+run done,1050
+d5 = 1
+'
+keep=
+
+# a thousand C functions are all found by name, and so are the built-ins
+# and the Unix functions added after them
+checkwith $registry "thousand C functions" 100 "got 0 7 3 9 5 0" \
+'print "got", fn0, fn7, fn123, fn999, abs(-5), exists("nofile")
+'
+
+# a name already taken, or one that a reserved word would hide, is refused
+for name in fn7 abs while print; do
+	checkwith $registry "$name refused" 100 "$name duplicate" ''
+done
+
+# the value stack grows a chunk at a time for deep recursion, stops
+# runaway recursion with an overflow, and is whole again afterwards
+recursion='function deep {if arg(1) {return deep(arg(1) - 1, arg(2), "at each level") + 1}; return 0}
+function runaway {return runaway(1, 2, 3)}
+'
+check "deep recursion" 100 "got 1000" "$recursion"'print "got", deep(1000, "x")
+'
+check "runaway recursion" 100 "exp overflow" "$recursion"'runaway
+'
+check "recursion after an overflow" 100 "got 1000" "$recursion"'runaway
+print "got", deep(1000, "x")
+'
+
+exit $failed